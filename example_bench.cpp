@@ -0,0 +1,363 @@
+#include <iostream>
+#include <iomanip>
+#include <algorithm>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <random>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "example.h" // generated from schema_pending.yaml into build/pending, see Makefile
+
+
+#define verify(condition) do { if (!(condition)) throw hoytech::error(#condition, "  |  ", __FILE__, ":", __LINE__); } while(0)
+
+
+static const uint64_t numUsers = 100'000;
+static const uint64_t numPersons = 100'000;
+static const auto runTime = std::chrono::seconds(2);
+
+
+static void populate(example::environment &env) {
+    auto txn = env.txn_rw();
+
+    for (uint64_t i = 0; i < numUsers; i++) {
+        env.insert_User(txn, std::string("user") + std::to_string(i), "\x01\x02\x03", i);
+    }
+
+    for (uint64_t i = 0; i < numPersons; i++) {
+        env.insert_Person(txn, "person", std::string("p") + std::to_string(i) + "@example.com", i % 100, "user");
+    }
+
+    txn.commit();
+}
+
+
+struct ReadResult {
+    uint64_t ops;
+    uint64_t writes;
+};
+
+// pooled=false opens a fresh txn_ro() per request. pooled=true goes through withReadTxn(), which reuses a
+// per-thread txn and cursors, the candidate fix for any contention the fresh-txn path shows.
+
+static ReadResult readMix(example::environment &env, size_t numThreads, bool withWriter, bool pooled) {
+    std::atomic<bool> done = false;
+    std::vector<uint64_t> opsPerThread(numThreads * 8, 0); // padded to keep counters on separate cache lines
+    uint64_t writes = 0;
+
+    std::vector<std::thread> threads;
+
+    for (size_t t = 0; t < numThreads; t++) {
+        threads.emplace_back([&, t]{
+            std::mt19937_64 rng(t);
+            uint64_t ops = 0;
+
+            auto request = [&](auto &txn){
+                auto view = env.lookup_User__userName(txn, std::string("user") + std::to_string(rng() % numUsers));
+                verify(view);
+
+                uint64_t seen = 0;
+                env.foreach_Person__age(txn, [&](auto &view){
+                    return ++seen < 10;
+                }, false, 18 + rng() % 80);
+            };
+
+            while (!done) {
+                if (pooled) {
+                    env.withReadTxn(request);
+                } else {
+                    auto txn = env.txn_ro();
+                    request(txn);
+                }
+
+                ops++;
+            }
+
+            opsPerThread[t * 8] = ops;
+        });
+    }
+
+    std::thread writer;
+
+    if (withWriter) {
+        writer = std::thread([&]{
+            std::mt19937_64 rng(12345);
+
+            while (!done) {
+                auto txn = env.txn_rw();
+                auto view = env.lookup_User(txn, 1 + rng() % numUsers);
+                env.update_User(txn, *view, { .created = rng() });
+                txn.commit();
+                writes++;
+            }
+        });
+    }
+
+    std::this_thread::sleep_for(runTime);
+    done = true;
+
+    for (auto &t : threads) t.join();
+    if (withWriter) writer.join();
+
+    uint64_t ops = 0;
+    for (size_t t = 0; t < numThreads; t++) ops += opsPerThread[t * 8];
+
+    return { ops, writes };
+}
+
+
+static void requestLatency(example::environment &env) {
+    std::cout << "== per-lookup latency, txn_ro() per request vs withReadTxn() ==" << std::endl;
+    std::cout << std::setw(16) << "lookups/request" << std::setw(14) << "txn_ro ns" << std::setw(16) << "withReadTxn ns" << std::endl;
+
+    const uint64_t numRequests = 200'000;
+
+    for (uint64_t lookupsPerRequest : { 1, 2, 4, 16, 64 }) {
+        auto run = [&](auto &&doRequest){
+            std::mt19937_64 rng(1);
+            auto start = std::chrono::steady_clock::now();
+
+            for (uint64_t i = 0; i < numRequests; i++) {
+                doRequest([&](auto &txn){
+                    for (uint64_t j = 0; j < lookupsPerRequest; j++) {
+                        auto view = env.lookup_User__userName(txn, std::string("user") + std::to_string(rng() % numUsers));
+                        verify(view);
+                    }
+                });
+            }
+
+            auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start);
+            return elapsed.count() / (numRequests * lookupsPerRequest);
+        };
+
+        auto fresh = run([&](auto &&cb){
+            auto txn = env.txn_ro();
+            cb(txn);
+        });
+
+        auto pooled = run([&](auto &&cb){
+            env.withReadTxn(cb);
+        });
+
+        std::cout << std::setw(16) << lookupsPerRequest << std::setw(14) << fresh << std::setw(16) << pooled << std::endl;
+    }
+
+    std::cout << std::endl;
+}
+
+
+static void uniqueFilters() {
+    std::cout << "== unique-index filters: bulk insert_User and miss-heavy lookup_Person__emailLC ==" << std::endl;
+    std::cout << std::setw(10) << "filters" << std::setw(14) << "insert ns" << std::setw(14) << "miss ns" << std::setw(14) << "hit ns" << std::endl;
+
+    const uint64_t numRows = 200'000, numLookups = 1'000'000;
+
+    for (bool filters : { false, true }) {
+        example::environment fenv;
+
+        verify(system("mkdir -p db/bench-filter/") == 0);
+        verify(system("rm -f db/bench-filter/data.mdb") == 0);
+
+        fenv.open("db/bench-filter/", { .uniqueFilters = filters });
+
+        auto nsPer = [](auto start, uint64_t n){
+            return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count() / n;
+        };
+
+        auto start = std::chrono::steady_clock::now();
+
+        {
+            auto txn = fenv.txn_rw();
+            for (uint64_t i = 0; i < numRows; i++) {
+                fenv.insert_User(txn, std::string("user") + std::to_string(i), "", i);
+                fenv.insert_Person(txn, "person", std::string("p") + std::to_string(i) + "@example.com", 30, "user");
+            }
+            txn.commit();
+        }
+
+        auto insertNs = nsPer(start, numRows * 2);
+
+        std::mt19937_64 rng(1);
+        auto txn = fenv.txn_ro();
+
+        start = std::chrono::steady_clock::now();
+        for (uint64_t i = 0; i < numLookups; i++) {
+            verify(!fenv.lookup_Person__emailLC(txn, std::string("q") + std::to_string(rng() % numRows) + "@example.com"));
+        }
+        auto missNs = nsPer(start, numLookups);
+
+        start = std::chrono::steady_clock::now();
+        for (uint64_t i = 0; i < numLookups; i++) {
+            verify(fenv.lookup_Person__emailLC(txn, std::string("p") + std::to_string(rng() % numRows) + "@example.com"));
+        }
+        auto hitNs = nsPer(start, numLookups);
+
+        std::cout << std::setw(10) << (filters ? "on" : "off") << std::setw(14) << insertNs << std::setw(14) << missNs << std::setw(14) << hitNs << std::endl;
+    }
+
+    std::cout << std::endl;
+}
+
+
+// Evict data.mdb from the page cache. Works without root because the pages are clean after the env is closed.
+
+static void dropPageCache(const std::string &path) {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    verify(fd != -1);
+    verify(posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED) == 0);
+    ::close(fd);
+}
+
+static void coldStart() {
+    std::cout << "== cold start: p99 lookup_User__userName latency per 100ms window ==" << std::endl;
+
+    {
+        example::environment cenv;
+
+        verify(system("mkdir -p db/bench-cold/") == 0);
+        verify(system("rm -f db/bench-cold/data.mdb") == 0);
+
+        cenv.open("db/bench-cold/");
+
+        auto txn = cenv.txn_rw();
+        for (uint64_t i = 0; i < 1'000'000; i++) cenv.insert_User(txn, std::string("user") + std::to_string(i), std::string(64, 'x'), i);
+        txn.commit();
+    }
+
+    for (bool warm : { false, true }) {
+        dropPageCache("db/bench-cold/data.mdb");
+
+        example::environment cenv;
+        cenv.open("db/bench-cold/", { .readahead = false, .accessPattern = example::AccessPattern::Random });
+
+        auto start = std::chrono::steady_clock::now();
+        auto sinceStart = [&]{ return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count(); };
+
+        if (warm) {
+            auto stats = cenv.warmup({ "User", "User__userName" }, { .threads = 8 });
+            std::cout << "  warmup: " << stats.pagesTouched << " pages in " << sinceStart() << "ms" << std::endl;
+        }
+
+        std::cout << std::setw(10) << (warm ? "warm ms" : "cold ms") << std::setw(12) << "p99 us" << std::endl;
+
+        std::mt19937_64 rng(1);
+
+        for (int window = 0; window < 20; window++) {
+            std::vector<uint64_t> latencies;
+            auto windowEnd = std::chrono::steady_clock::now() + std::chrono::milliseconds(100);
+
+            while (std::chrono::steady_clock::now() < windowEnd) {
+                auto t = std::chrono::steady_clock::now();
+                {
+                    auto txn = cenv.txn_ro();
+                    verify(cenv.lookup_User__userName(txn, std::string("user") + std::to_string(rng() % 1'000'000)));
+                }
+                latencies.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - t).count());
+            }
+
+            std::sort(latencies.begin(), latencies.end());
+            std::cout << std::setw(10) << sinceStart() << std::setw(12) << latencies[latencies.size() * 99 / 100] / 1000 << std::endl;
+        }
+    }
+
+    std::cout << std::endl;
+}
+
+
+static void commitThroughput() {
+    std::cout << "== commit throughput by durability mode (1 insert_User per txn) ==" << std::endl;
+    std::cout << std::setw(28) << "mode" << std::setw(14) << "commits/s" << std::endl;
+
+    // Waiting for durability wakes the syncer instead of waiting out syncInterval, so with a single writer
+    // wait-for-durable pays one sync per commit, like Full. Waiting once every 100 commits shows what grouping
+    // commits under one sync buys
+
+    struct Mode {
+        const char *name;
+        example::Durability durability;
+        example::CommitMode commitMode;
+        uint64_t waitEvery = 0;
+    };
+
+    for (auto mode : {
+        Mode{ "Full", example::Durability::Full, example::CommitMode::Async },
+        Mode{ "NoMetaSync", example::Durability::NoMetaSync, example::CommitMode::Async },
+        Mode{ "NoSync, fire-and-forget", example::Durability::NoSync, example::CommitMode::Async },
+        Mode{ "NoSync, wait-for-durable", example::Durability::NoSync, example::CommitMode::WaitDurable },
+        Mode{ "NoSync, wait every 100", example::Durability::NoSync, example::CommitMode::Async, 100 },
+    }) {
+        example::environment denv;
+
+        verify(system("mkdir -p db/bench-durable/") == 0);
+        verify(system("rm -f db/bench-durable/data.mdb") == 0);
+
+        denv.open("db/bench-durable/", { .durability = mode.durability, .syncInterval = std::chrono::milliseconds(100) });
+
+        uint64_t commits = 0;
+        auto start = std::chrono::steady_clock::now();
+        auto end = start + runTime;
+
+        while (std::chrono::steady_clock::now() < end) {
+            auto txn = denv.txn_rw();
+            denv.insert_User(txn, std::string("user") + std::to_string(commits), "", commits);
+            auto seq = denv.commit(txn, mode.commitMode);
+            commits++;
+
+            if (mode.waitEvery && commits % mode.waitEvery == 0) denv.waitDurable(seq);
+        }
+
+        std::cout << std::setw(28) << mode.name << std::setw(14) << (uint64_t)((double)commits / runTime.count()) << std::endl;
+    }
+
+    std::cout << std::endl;
+}
+
+
+int main() {
+    example::environment env;
+
+    verify(system("mkdir -p db/bench/") == 0);
+    verify(system("rm -f db/bench/data.mdb") == 0);
+
+    env.open("db/bench/");
+
+    populate(env);
+
+    requestLatency(env);
+    uniqueFilters();
+    coldStart();
+    commitThroughput();
+
+    std::cout << "cores: " << std::thread::hardware_concurrency() << std::endl << std::endl;
+
+    for (bool withWriter : { false, true }) {
+        for (bool pooled : { false, true }) {
+            std::cout << "== lookup_User__userName + foreach_Person__age, " << (pooled ? "withReadTxn" : "txn_ro per request") << ", "
+                      << (withWriter ? "with" : "no") << " concurrent update_User writer ==" << std::endl;
+            std::cout << std::setw(8) << "threads" << std::setw(14) << "reads/s" << std::setw(10) << "scaling" << std::setw(12) << "writes/s" << std::endl;
+
+            double base = 0;
+
+            for (size_t numThreads : { 1, 2, 4, 8, 16, 32, 64 }) {
+                auto res = readMix(env, numThreads, withWriter, pooled);
+
+                double rate = (double)res.ops / runTime.count();
+                if (numThreads == 1) base = rate;
+
+                std::cout << std::setw(8) << numThreads
+                          << std::setw(14) << (uint64_t)rate
+                          << std::setw(10) << std::fixed << std::setprecision(2) << rate / base
+                          << std::setw(12) << (uint64_t)((double)res.writes / runTime.count())
+                          << std::endl;
+            }
+
+            std::cout << std::endl;
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,757 @@
+#include <iostream>
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <functional>
+#include <map>
+
+#include "hoytech-cpp/hoytech/hex.h"
+#include "example.h" // generated from schema_pending.yaml into build/pending, see Makefile
+
+
+// Randomised index-consistency checker. Applies batches of random insert/update/delete
+// operations to every table, then recomputes each table's index entries with
+// getIndices_<Table> and compares them against the index DBIs.
+//
+//   ./fuzz_test [--ops N] [--batch N] [--seed N] [--slow] [--keep]
+//
+// Default verification sorts the expected and actual entries of each index and
+// merge-compares them (fast enough for 10M+ rows). --slow instead probes every
+// expected entry with MDB_GET_BOTH, which is useful to cross-check the fast mode.
+
+
+#define verify(condition) do { if (!(condition)) throw hoytech::error(#condition, "  |  ", __FILE__, ":", __LINE__); } while(0)
+
+
+using Entries = std::vector<std::pair<std::string, uint64_t>>;
+using Sets = std::map<std::string, std::vector<uint64_t>>;
+
+static std::string encodeKey(std::string_view s) { return std::string(s); }
+static std::string encodeKey(uint64_t n) { return std::string(lmdb::to_sv<uint64_t>(n)); }
+
+template<typename T>
+static void addEntries(Entries &out, const std::optional<T> &k, uint64_t id) {
+    if (k) out.emplace_back(encodeKey(*k), id);
+}
+
+template<typename T>
+static void addEntries(Entries &out, const std::vector<T> &ks, uint64_t id) {
+    for (const auto &k : ks) out.emplace_back(encodeKey(k), id);
+}
+
+template<typename K>
+static void addSets(Sets &out, const K &k, uint64_t id) {
+    Entries e;
+    addEntries(e, k, id);
+    for (auto &[key, id] : e) out[key].push_back(id);
+}
+
+
+struct Verifier {
+    bool slow = false;
+    uint64_t entriesChecked = 0;
+    uint64_t mismatches = 0;
+
+    void report(const char *index, const char *what, std::string_view key, uint64_t id) {
+        if (mismatches++ < 20) std::cerr << "MISMATCH " << index << ": " << what << " key=" << hoytech::to_hex(key) << " id=" << id << std::endl;
+    }
+
+    void compare(lmdb::txn &txn, lmdb::dbi dbi, const char *index, Entries &expected) {
+        std::sort(expected.begin(), expected.end());
+        expected.erase(std::unique(expected.begin(), expected.end()), expected.end()); // same key twice in one row is stored once
+        entriesChecked += expected.size();
+
+        auto cursor = lmdb::cursor::open(txn, dbi);
+        std::string_view k, v;
+
+        if (slow) {
+            uint64_t present = 0;
+
+            for (auto &[key, id] : expected) {
+                k = key;
+                v = lmdb::to_sv<uint64_t>(id);
+                if (cursor.get(k, v, MDB_GET_BOTH)) present++;
+                else report(index, "missing", key, id);
+            }
+
+            // Every present entry is also counted here, so whatever is left over is extra. Probing can't
+            // say which entries those are, re-run without --slow to list them.
+
+            uint64_t actualCount = 0;
+            for (bool found = cursor.get(k, v, MDB_FIRST); found; found = cursor.get(k, v, MDB_NEXT)) actualCount++;
+
+            if (actualCount > present) {
+                uint64_t extra = actualCount - present;
+                std::cerr << "MISMATCH " << index << ": " << extra << " extra entries" << std::endl;
+                mismatches += extra;
+            }
+
+            return;
+        }
+
+        Entries actual;
+        actual.reserve(expected.size());
+        for (bool found = cursor.get(k, v, MDB_FIRST); found; found = cursor.get(k, v, MDB_NEXT)) {
+            actual.emplace_back(std::string(k), lmdb::from_sv<uint64_t>(v));
+        }
+        std::sort(actual.begin(), actual.end());
+
+        auto e = expected.begin(), a = actual.begin();
+
+        while (e != expected.end() || a != actual.end()) {
+            if (a == actual.end() || (e != expected.end() && *e < *a)) {
+                report(index, "missing", e->first, e->second);
+                e++;
+            } else if (e == expected.end() || *a < *e) {
+                report(index, "extra", a->first, a->second);
+                a++;
+            } else {
+                e++;
+                a++;
+            }
+        }
+    }
+
+    // Bitmap and fulltext indices aren't one entry per (key, id), so compare them through their query APIs
+
+    void compareSets(const char *index, Sets &expected, const std::function<void(std::function<void(std::string_view)>)> &foreachKey, const std::function<std::vector<uint64_t>(std::string_view)> &getIds) {
+        for (auto &[key, ids] : expected) {
+            std::sort(ids.begin(), ids.end());
+            ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+            entriesChecked += ids.size();
+            if (getIds(key) != ids) report(index, "set differs", key, ids.size());
+        }
+
+        foreachKey([&](std::string_view key){
+            if (!expected.contains(std::string(key))) report(index, "stale key", key, 0);
+        });
+    }
+};
+
+
+struct Fuzzer {
+    example::environment &env;
+    std::mt19937_64 rng;
+
+    std::map<std::string, uint64_t> maxIds;
+    uint64_t ops = 0, expectedErrors = 0;
+
+    Fuzzer(example::environment &env) : env(env) {}
+
+    uint64_t rnd(uint64_t n) { return rng() % n; }
+
+    std::string word(uint64_t alphabet = 8) { return std::string("w") + std::to_string(rnd(alphabet)); }
+
+    std::string words(uint64_t n, uint64_t alphabet = 8) {
+        std::string out;
+        for (uint64_t i = 0; i < n; i++) {
+            if (i) out += " ";
+            out += word(alphabet);
+        }
+        return out;
+    }
+
+    std::string bytes(uint64_t maxLen) {
+        std::string out(rnd(maxLen + 1), '\0');
+        for (auto &c : out) c = (char)rnd(4);
+        return out;
+    }
+
+    template<typename T>
+    std::vector<T> nums(uint64_t maxLen, uint64_t range) {
+        std::vector<T> out(rnd(maxLen + 1));
+        for (auto &n : out) n = (T)rnd(range);
+        return out;
+    }
+
+    std::vector<std::string> strs(uint64_t maxLen) {
+        std::vector<std::string> out(rnd(maxLen + 1));
+        for (auto &s : out) s = word(16);
+        return out;
+    }
+
+    // Run op, counting errors that the schema is supposed to produce. Anything else is a real failure.
+
+    void attempt(const std::function<void()> &op) {
+        try {
+            op();
+        } catch (const std::runtime_error &e) {
+            std::string_view msg = e.what();
+            if (msg.find("unique constraint violated") == std::string_view::npos
+                && msg.find("duplicate insert into") == std::string_view::npos
+                && msg.find("too short") == std::string_view::npos
+                && msg.find("referenced row not found") == std::string_view::npos
+                && msg.find("delete restricted") == std::string_view::npos) throw;
+            expectedErrors++;
+        }
+    }
+
+    template<typename F>
+    void withRandomRow(const char *table, F &&lookup) {
+        uint64_t maxId = maxIds[table];
+        if (maxId) lookup(1 + rnd(maxId));
+    }
+
+    void track(const char *table, uint64_t id) {
+        maxIds[table] = std::max(maxIds[table], id);
+    }
+
+    void step(lmdb::txn &txn) {
+        ops++;
+
+        switch (rnd(17)) {
+            case 0: {
+                auto op = rnd(4);
+                if (op < 2) attempt([&]{ track("User", env.insert_User(txn, word(5000), bytes(8), rnd(3) ? rnd(100) : 0)); });
+                else withRandomRow("User", [&](uint64_t id){
+                    auto view = env.lookup_User(txn, id);
+                    if (!view) return;
+                    if (op == 2) attempt([&]{ env.update_User(txn, *view, { .userName = word(5000), .created = rnd(100) }); });
+                    else attempt([&]{ env.delete_User(txn, id); }); // restricted while an Account references it
+                });
+                break;
+            }
+
+            case 1: {
+                auto op = rnd(4);
+                std::string fullName = rnd(2) ? "Name" + word(20) : "name" + word(20);
+                std::string email = word(5000) + (rnd(2) ? "@EXAMPLE.com" : "@example.com");
+                std::string role = rnd(4) ? "user" : (rnd(2) ? "admin" : "role" + word(4));
+                if (op < 2) attempt([&]{ track("Person", env.insert_Person(txn, fullName, email, rnd(40), role)); });
+                else withRandomRow("Person", [&](uint64_t id){
+                    auto view = env.lookup_Person(txn, id);
+                    if (!view) return;
+                    if (op == 2) attempt([&]{ env.update_Person(txn, *view, { .email = email, .age = rnd(40), .role = role }); });
+                    else env.delete_Person(txn, id);
+                });
+                break;
+            }
+
+            case 2: {
+                auto op = rnd(4);
+                if (op < 2) attempt([&]{ track("Phrase", env.insert_Phrase(txn, words(rnd(6), 50))); });
+                else withRandomRow("Phrase", [&](uint64_t id){
+                    auto view = env.lookup_Phrase(txn, id);
+                    if (!view) return;
+                    if (op == 2) env.update_Phrase(txn, *view, { .words = words(rnd(6), 50) });
+                    else env.delete_Phrase(txn, id);
+                });
+                break;
+            }
+
+            case 3: {
+                uint64_t id = 1 + rnd(10000);
+                if (rnd(2)) attempt([&]{ env.insert_SomeRecord(txn, id, word()); });
+                else if (env.lookup_SomeRecord(txn, id)) env.delete_SomeRecord(txn, id);
+                break;
+            }
+
+            case 4: {
+                auto op = rnd(4);
+                if (op < 2) attempt([&]{ track("MultiRecs", env.insert_MultiRecs(txn, env.views(strs(4)), env.views(strs(2)), nums<uint64_t>(4, 20))); });
+                else withRandomRow("MultiRecs", [&](uint64_t id){
+                    auto view = env.lookup_MultiRecs(txn, id);
+                    if (!view) return;
+                    if (op == 2) {
+                        auto newStrs = strs(4);
+                        env.update_MultiRecs(txn, *view, { .strs = env.views(newStrs), .ints = nums<uint64_t>(4, 20) });
+                    }
+                    else env.delete_MultiRecs(txn, id);
+                });
+                break;
+            }
+
+            case 5: {
+                if (rnd(3)) attempt([&]{ track("Embedding", env.insert_Embedding(txn, word(100), nums<float>(20, 100), nums<uint32_t>(5, 100), nums<double>(3, 100))); });
+                else withRandomRow("Embedding", [&](uint64_t id){
+                    if (env.lookup_Embedding(txn, id)) env.delete_Embedding(txn, id);
+                });
+                break;
+            }
+
+            case 6: {
+                auto op = rnd(4);
+                if (op < 2) attempt([&]{ track("Tagged", env.insert_Tagged(txn, word(6), nums<uint64_t>(3, 10))); });
+                else withRandomRow("Tagged", [&](uint64_t id){
+                    auto view = env.lookup_Tagged(txn, id);
+                    if (!view) return;
+                    if (op == 2) env.update_Tagged(txn, *view, { .color = word(6) });
+                    else env.delete_Tagged(txn, id);
+                });
+                break;
+            }
+
+            case 7: {
+                if (rnd(3)) attempt([&]{ track("NullIndices", env.insert_NullIndices(txn, bytes(2), rnd(3))); });
+                else withRandomRow("NullIndices", [&](uint64_t id){
+                    if (env.lookup_NullIndices(txn, id)) env.delete_NullIndices(txn, id);
+                });
+                break;
+            }
+
+            case 8: {
+                auto op = rnd(4);
+                if (op < 2) attempt([&]{ track("CustomComp", env.insert_CustomComp(txn, word(5), rnd(2000))); });
+                else withRandomRow("CustomComp", [&](uint64_t id){
+                    auto view = env.lookup_CustomComp(txn, id);
+                    if (!view) return;
+                    if (op == 2) env.update_CustomComp(txn, *view, { .created = rnd(2000) });
+                    else env.delete_CustomComp(txn, id);
+                });
+                break;
+            }
+
+            case 9: {
+                if (rnd(3)) attempt([&]{ track("SimpleDups", env.insert_SimpleDups(txn, word(4))); });
+                else withRandomRow("SimpleDups", [&](uint64_t id){
+                    if (env.lookup_SimpleDups(txn, id)) env.delete_SimpleDups(txn, id);
+                });
+                break;
+            }
+
+            case 10: {
+                // Buffers shorter than 3 bytes make the prelude throw, which must leave no partial writes behind
+                uint64_t id = 1 + rnd(10000);
+                if (rnd(2)) attempt([&]{ env.insert_MyOpaqueTable(txn, id, bytes(6)); });
+                else if (env.lookup_MyOpaqueTable(txn, id)) env.delete_MyOpaqueTable(txn, id);
+                break;
+            }
+
+            case 11: {
+                if (rnd(3)) attempt([&]{ track("MyOpaqueTableAutoPrimary", env.insert_MyOpaqueTableAutoPrimary(txn, word(50))); });
+                else withRandomRow("MyOpaqueTableAutoPrimary", [&](uint64_t id){
+                    if (env.lookup_MyOpaqueTableAutoPrimary(txn, id)) env.delete_MyOpaqueTableAutoPrimary(txn, id);
+                });
+                break;
+            }
+
+            case 12: {
+                auto op = rnd(4);
+                std::string body = words(rnd(2) ? 3 : 200, 50);
+                if (op < 2) attempt([&]{ track("CompressedDoc", env.insert_CompressedDoc(txn, word(50), body, bytes(rnd(2) ? 4 : 3000))); });
+                else withRandomRow("CompressedDoc", [&](uint64_t id){
+                    auto view = env.lookup_CompressedDoc(txn, id);
+                    if (!view) return;
+                    if (op == 2) env.update_CompressedDoc(txn, *view, { .title = word(50), .body = body });
+                    else env.delete_CompressedDoc(txn, id);
+                });
+                break;
+            }
+
+            case 13: {
+                if (rnd(3)) attempt([&]{ track("MyOpaqueCompressed", env.insert_MyOpaqueCompressed(txn, word(50) + words(rnd(2) ? 1 : 100, 50))); });
+                else withRandomRow("MyOpaqueCompressed", [&](uint64_t id){
+                    if (env.lookup_MyOpaqueCompressed(txn, id)) env.delete_MyOpaqueCompressed(txn, id);
+                });
+                break;
+            }
+
+            case 14: {
+                auto op = rnd(4);
+                if (op < 2) attempt([&]{ track("HashCollide", env.insert_HashCollide(txn, word(500))); });
+                else withRandomRow("HashCollide", [&](uint64_t id){
+                    auto view = env.lookup_HashCollide(txn, id);
+                    if (!view) return;
+                    if (op == 2) attempt([&]{ env.update_HashCollide(txn, *view, { .code = word(500) }); });
+                    else env.delete_HashCollide(txn, id);
+                });
+                break;
+            }
+
+            case 15: {
+                auto op = rnd(4);
+                uint64_t owner = rnd(maxIds["User"] + 1);
+                if (op < 2) attempt([&]{ track("Account", env.insert_Account(txn, owner, word())); });
+                else withRandomRow("Account", [&](uint64_t id){
+                    auto view = env.lookup_Account(txn, id);
+                    if (!view) return;
+                    if (op == 2) attempt([&]{ env.update_Account(txn, *view, { .owner = owner }); });
+                    else env.delete_Account(txn, id);
+                });
+                break;
+            }
+
+            case 16: {
+                uint64_t user = 1 + rnd(maxIds["User"] + 1);
+                if (rnd(3)) attempt([&]{ track("Session", env.insert_Session(txn, user, bytes(4))); });
+                else withRandomRow("Session", [&](uint64_t id){
+                    if (env.lookup_Session(txn, id)) env.delete_Session(txn, id);
+                });
+                break;
+            }
+        }
+    }
+};
+
+
+static uint64_t lastKey(lmdb::txn &txn, lmdb::dbi &dbi) {
+    auto cursor = lmdb::cursor::open(txn, dbi);
+    std::string_view k, v;
+    return cursor.get(k, v, MDB_LAST) ? lmdb::from_sv<uint64_t>(k) : 0;
+}
+
+
+static void verifyAll(example::environment &env, lmdb::txn &txn, Verifier &v) {
+    {
+        Entries userName, created;
+        env.foreach_User(txn, [&](auto &view){
+            auto ix = env.getIndices_User(view);
+            addEntries(userName, ix.userName, view.primaryKeyId);
+            addEntries(created, ix.created, view.primaryKeyId);
+            return true;
+        });
+        v.compare(txn, env.dbi_User__userName, "User__userName", userName);
+        v.compare(txn, env.dbi_User__created, "User__created", created);
+    }
+
+    {
+        Entries fullNameLC, emailLC, age, role;
+        env.foreach_Person(txn, [&](auto &view){
+            auto ix = env.getIndices_Person(view);
+            addEntries(fullNameLC, ix.fullNameLC, view.primaryKeyId);
+            addEntries(emailLC, ix.emailLC, view.primaryKeyId);
+            addEntries(age, ix.age, view.primaryKeyId);
+            addEntries(role, ix.role, view.primaryKeyId);
+            return true;
+        });
+        v.compare(txn, env.dbi_Person__fullNameLC, "Person__fullNameLC", fullNameLC);
+        for (auto &e : emailLC) e.first = env.hashKey_Person__emailLC(e.first);
+        v.compare(txn, env.dbi_Person__emailLC, "Person__emailLC", emailLC);
+        v.compare(txn, env.dbi_Person__age, "Person__age", age);
+
+        // Dictionary index keys are codes, not strings
+
+        Entries roleCodes;
+        for (auto &[key, id] : role) {
+            auto code = env.dictCode_Person__role(txn, key);
+            if (code) roleCodes.emplace_back(encodeKey(*code), id);
+            else v.report("Person__role", "no dictionary code", key, id);
+        }
+        v.compare(txn, env.dbi_Person__role, "Person__role", roleCodes);
+    }
+
+    {
+        Entries splitWords;
+        Sets terms;
+        env.foreach_Phrase(txn, [&](auto &view){
+            auto ix = env.getIndices_Phrase(view);
+            addEntries(splitWords, ix.splitWords, view.primaryKeyId);
+            addSets(terms, ix.terms, view.primaryKeyId);
+            return true;
+        });
+        v.compare(txn, env.dbi_Phrase__splitWords, "Phrase__splitWords", splitWords);
+        v.compareSets("Phrase__terms", terms,
+            [&](auto cb){ env.foreachKey_Phrase__terms(txn, [&](auto key){ cb(key); return true; }); },
+            [&](std::string_view term){
+                std::vector<uint64_t> ids;
+                env.searchAll_Phrase__terms(txn, { std::string(term) }, [&](auto &view){ ids.push_back(view.primaryKeyId); return true; });
+                return ids;
+            });
+    }
+
+    {
+        Entries strs, ubytesField;
+        Sets ints;
+        env.foreach_MultiRecs(txn, [&](auto &view){
+            auto ix = env.getIndices_MultiRecs(view);
+            addEntries(strs, ix.strs, view.primaryKeyId);
+            addEntries(ubytesField, ix.ubytesField, view.primaryKeyId);
+            addSets(ints, ix.ints, view.primaryKeyId);
+            return true;
+        });
+        v.compare(txn, env.dbi_MultiRecs__strs, "MultiRecs__strs", strs);
+        v.compare(txn, env.dbi_MultiRecs__ubytesField, "MultiRecs__ubytesField", ubytesField);
+        v.compareSets("MultiRecs__ints", ints,
+            [&](auto cb){ env.foreachKey_MultiRecs__ints(txn, [&](auto key){ cb(encodeKey(key)); return true; }); },
+            [&](std::string_view key){ return env.bitmap_MultiRecs__ints(txn, lmdb::from_sv<uint64_t>(key)).ids(); });
+    }
+
+    {
+        Entries label;
+        env.foreach_Embedding(txn, [&](auto &view){
+            addEntries(label, env.getIndices_Embedding(view).label, view.primaryKeyId);
+            return true;
+        });
+        v.compare(txn, env.dbi_Embedding__label, "Embedding__label", label);
+    }
+
+    {
+        Sets color, tags;
+        env.foreach_Tagged(txn, [&](auto &view){
+            auto ix = env.getIndices_Tagged(view);
+            addSets(color, ix.color, view.primaryKeyId);
+            addSets(tags, ix.tags, view.primaryKeyId);
+            return true;
+        });
+        v.compareSets("Tagged__color", color,
+            [&](auto cb){ env.foreachKey_Tagged__color(txn, [&](auto key){ cb(key); return true; }); },
+            [&](std::string_view key){ return env.bitmap_Tagged__color(txn, key).ids(); });
+        v.compareSets("Tagged__tags", tags,
+            [&](auto cb){ env.foreachKey_Tagged__tags(txn, [&](auto key){ cb(encodeKey(key)); return true; }); },
+            [&](std::string_view key){ return env.bitmap_Tagged__tags(txn, lmdb::from_sv<uint64_t>(key)).ids(); });
+    }
+
+    {
+        Entries passwordHash, created;
+        env.foreach_NullIndices(txn, [&](auto &view){
+            auto ix = env.getIndices_NullIndices(view);
+            addEntries(passwordHash, ix.passwordHash, view.primaryKeyId);
+            addEntries(created, ix.created, view.primaryKeyId);
+            return true;
+        });
+        v.compare(txn, env.dbi_NullIndices__passwordHash, "NullIndices__passwordHash", passwordHash);
+        v.compare(txn, env.dbi_NullIndices__created, "NullIndices__created", created);
+    }
+
+    {
+        Entries desc, descByCreated;
+        env.foreach_CustomComp(txn, [&](auto &view){
+            auto ix = env.getIndices_CustomComp(view);
+            addEntries(desc, ix.desc, view.primaryKeyId);
+            addEntries(descByCreated, ix.descByCreated, view.primaryKeyId);
+            return true;
+        });
+        v.compare(txn, env.dbi_CustomComp__desc, "CustomComp__desc", desc);
+        v.compare(txn, env.dbi_CustomComp__descByCreated, "CustomComp__descByCreated", descByCreated);
+    }
+
+    {
+        Entries stuff;
+        env.foreach_SimpleDups(txn, [&](auto &view){
+            addEntries(stuff, env.getIndices_SimpleDups(view).stuff, view.primaryKeyId);
+            return true;
+        });
+        v.compare(txn, env.dbi_SimpleDups__stuff, "SimpleDups__stuff", stuff);
+    }
+
+    {
+        Entries someStr, someInt, someStrsMulti;
+        env.foreach_MyOpaqueTable(txn, [&](auto &view){
+            auto ix = env.getIndices_MyOpaqueTable(view);
+            addEntries(someStr, ix.someStr, view.primaryKeyId);
+            addEntries(someInt, ix.someInt, view.primaryKeyId);
+            addEntries(someStrsMulti, ix.someStrsMulti, view.primaryKeyId);
+            return true;
+        });
+        v.compare(txn, env.dbi_MyOpaqueTable__someStr, "MyOpaqueTable__someStr", someStr);
+        v.compare(txn, env.dbi_MyOpaqueTable__someInt, "MyOpaqueTable__someInt", someInt);
+        v.compare(txn, env.dbi_MyOpaqueTable__someStrsMulti, "MyOpaqueTable__someStrsMulti", someStrsMulti);
+    }
+
+    {
+        Entries someStr;
+        env.foreach_MyOpaqueTableAutoPrimary(txn, [&](auto &view){
+            addEntries(someStr, env.getIndices_MyOpaqueTableAutoPrimary(view).someStr, view.primaryKeyId);
+            return true;
+        });
+        v.compare(txn, env.dbi_MyOpaqueTableAutoPrimary__someStr, "MyOpaqueTableAutoPrimary__someStr", someStr);
+    }
+
+    {
+        Entries title;
+        env.foreach_CompressedDoc(txn, [&](auto &view){
+            addEntries(title, env.getIndices_CompressedDoc(view).title, view.primaryKeyId);
+            return true;
+        });
+        v.compare(txn, env.dbi_CompressedDoc__title, "CompressedDoc__title", title);
+    }
+
+    {
+        Entries someStr;
+        env.foreach_MyOpaqueCompressed(txn, [&](auto &view){
+            addEntries(someStr, env.getIndices_MyOpaqueCompressed(view).someStr, view.primaryKeyId);
+            return true;
+        });
+        v.compare(txn, env.dbi_MyOpaqueCompressed__someStr, "MyOpaqueCompressed__someStr", someStr);
+    }
+
+    {
+        Entries owner;
+        env.foreach_Account(txn, [&](auto &view){
+            addEntries(owner, env.getIndices_Account(view).owner, view.primaryKeyId);
+            if (view.owner()) verify(env.lookup_User(txn, view.owner()));
+            return true;
+        });
+        v.compare(txn, env.dbi_Account__owner, "Account__owner", owner);
+    }
+
+    {
+        Entries user;
+        env.foreach_Session(txn, [&](auto &view){
+            addEntries(user, env.getIndices_Session(view).user, view.primaryKeyId);
+            verify(env.lookup_User(txn, view.user())); // cascaded deletes leave no dangling sessions
+            return true;
+        });
+        v.compare(txn, env.dbi_Session__user, "Session__user", user);
+    }
+
+    {
+        Entries code;
+        env.foreach_HashCollide(txn, [&](auto &view){
+            addEntries(code, env.getIndices_HashCollide(view).code, view.primaryKeyId);
+            return true;
+        });
+        for (auto &e : code) e.first = env.hashKey_HashCollide__code(e.first);
+        v.compare(txn, env.dbi_HashCollide__code, "HashCollide__code", code);
+    }
+
+    // Aggregates are maintained incrementally, so recompute every group from the rows and compare both ways
+
+    {
+        struct Group { uint64_t count = 0, sumAge = 0; };
+        std::map<std::string, Group> byRole;
+
+        env.foreach_Person(txn, [&](auto &view){
+            auto &g = byRole[std::string(view.role())];
+            g.count++;
+            g.sumAge += view.age();
+            return true;
+        });
+
+        uint64_t matched = 0;
+
+        env.aggregate_Person__countByRole(txn, [&](auto key, auto &agg){
+            auto it = byRole.find(std::string(key));
+            if (it == byRole.end()) v.report("Person__countByRole", "extra group", key, agg.count);
+            else if (agg.count != it->second.count || agg.sum_age != it->second.sumAge) v.report("Person__countByRole", "group differs", key, agg.count);
+            else matched++;
+            return true;
+        });
+
+        v.entriesChecked += byRole.size();
+        if (matched < byRole.size()) v.report("Person__countByRole", "missing or differing groups", "", byRole.size() - matched);
+    }
+
+    {
+        std::map<uint64_t, uint64_t> byDay;
+
+        env.foreach_User(txn, [&](auto &view){
+            byDay[view.created() / 86400]++;
+            return true;
+        });
+
+        uint64_t matched = 0;
+
+        env.aggregate_User__usersByDay(txn, [&](auto day, auto &agg){
+            auto it = byDay.find(day);
+            if (it == byDay.end()) v.report("User__usersByDay", "extra group", encodeKey(day), agg.count);
+            else if (agg.count != it->second) v.report("User__usersByDay", "group differs", encodeKey(day), agg.count);
+            else matched++;
+            return true;
+        });
+
+        v.entriesChecked += byDay.size();
+        if (matched < byDay.size()) v.report("User__usersByDay", "missing or differing groups", "", byDay.size() - matched);
+    }
+}
+
+
+int main(int argc, char **argv) {
+    uint64_t totalOps = 1'000'000;
+    uint64_t batchSize = 100'000;
+    uint64_t seed = 1;
+    bool slow = false, keep = false;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--ops" && i + 1 < argc) totalOps = std::stoull(argv[++i]);
+        else if (arg == "--batch" && i + 1 < argc) batchSize = std::stoull(argv[++i]);
+        else if (arg == "--seed" && i + 1 < argc) seed = std::stoull(argv[++i]);
+        else if (arg == "--slow") slow = true;
+        else if (arg == "--keep") keep = true; // continue on an existing db/fuzz/, eg one built up by an earlier run
+        else throw hoytech::error("unknown argument: ", arg);
+    }
+
+    verify(system("mkdir -p db/fuzz/") == 0);
+    if (!keep) verify(system("rm -f db/fuzz/data.mdb") == 0);
+
+    example::environment env;
+
+    env.open("db/fuzz/", {
+        .mapSize = 1ULL * 1024 * 1024 * 1024,
+        .mapSizeGrowthFactor = 2,
+        .mapSizeMax = 1ULL * 1024 * 1024 * 1024 * 1024,
+    });
+
+    Fuzzer fuzzer(env);
+
+    // With --keep, random row picks have to reach the rows already there, and the row count goes into the
+    // batch seeds so a rerun doesn't replay the operations of the run that built the db
+
+    uint64_t existingRows = 0;
+
+    {
+        auto txn = env.txn_ro();
+
+        auto table = [&](const char *name, lmdb::dbi &dbi, bool autoIncrement = true){
+            if (autoIncrement) fuzzer.maxIds[name] = lastKey(txn, dbi);
+            existingRows += dbi.size(txn);
+        };
+
+        table("User", env.dbi_User);
+        table("Person", env.dbi_Person);
+        table("Phrase", env.dbi_Phrase);
+        table("SomeRecord", env.dbi_SomeRecord, false);
+        table("MultiRecs", env.dbi_MultiRecs);
+        table("Embedding", env.dbi_Embedding);
+        table("Tagged", env.dbi_Tagged);
+        table("NullIndices", env.dbi_NullIndices);
+        table("CustomComp", env.dbi_CustomComp);
+        table("SimpleDups", env.dbi_SimpleDups);
+        table("MyOpaqueTable", env.dbi_MyOpaqueTable, false);
+        table("MyOpaqueTableAutoPrimary", env.dbi_MyOpaqueTableAutoPrimary);
+        table("CompressedDoc", env.dbi_CompressedDoc);
+        table("MyOpaqueCompressed", env.dbi_MyOpaqueCompressed);
+        table("HashCollide", env.dbi_HashCollide);
+        table("Account", env.dbi_Account);
+        table("Session", env.dbi_Session);
+    }
+
+    std::cout << "seed=" << seed << " ops=" << totalOps << " batch=" << batchSize << " verify=" << (slow ? "slow" : "fast")
+              << " existingRows=" << existingRows << std::endl;
+
+    for (uint64_t batch = 0, done = 0; done < totalOps; batch++) {
+        uint64_t n = std::min(batchSize, totalOps - done);
+
+        auto start = std::chrono::steady_clock::now();
+
+        // Reseed and restore the counters at the start of the callback so a retry after map growth replays the
+        // same operations and counts them once
+
+        auto maxIdsBefore = fuzzer.maxIds;
+        auto opsBefore = fuzzer.ops, expectedErrorsBefore = fuzzer.expectedErrors;
+
+        env.writeTxn([&](auto &txn){
+            std::seed_seq batchSeed{ seed, batch, existingRows };
+            fuzzer.rng.seed(batchSeed);
+            fuzzer.maxIds = maxIdsBefore;
+            fuzzer.ops = opsBefore;
+            fuzzer.expectedErrors = expectedErrorsBefore;
+            for (uint64_t i = 0; i < n; i++) fuzzer.step(txn);
+        });
+
+        done += n;
+
+        auto applied = std::chrono::steady_clock::now();
+
+        Verifier v{ .slow = slow };
+
+        {
+            auto txn = env.txn_ro();
+            verifyAll(env, txn, v);
+        }
+
+        auto verified = std::chrono::steady_clock::now();
+
+        auto ms = [](auto d){ return std::chrono::duration_cast<std::chrono::milliseconds>(d).count(); };
+
+        std::cout << "batch " << batch << ": ops=" << done << " entries=" << v.entriesChecked
+                  << " apply=" << ms(applied - start) << "ms verify=" << ms(verified - applied) << "ms" << std::endl;
+
+        if (v.mismatches) throw hoytech::error("index inconsistency: ", v.mismatches, " mismatches in batch ", batch);
+    }
+
+    std::cout << "All " << fuzzer.ops << " ops consistent (" << fuzzer.expectedErrors << " expected errors)." << std::endl;
+
+    return 0;
+}
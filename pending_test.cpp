@@ -0,0 +1,2810 @@
+#include <iostream>
+#include <algorithm>
+#include <thread>
+#include <atomic>
+#include <span>
+#include <set>
+#include <future>
+#include <functional>
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "hoytech-cpp/hoytech/assert_zerocopy.h"
+#include "example.h" // generated from schema_pending.yaml into build/pending, see Makefile
+
+
+#define verify(condition) do { if (!(condition)) throw hoytech::error(#condition, "  |  ", __FILE__, ":", __LINE__); } while(0)
+#define verifyThrow(condition, expected) { \
+    bool caught = false; \
+    std::string errorMsg; \
+    try { condition; } \
+    catch (const std::runtime_error &e) { \
+        caught = true; \
+        errorMsg = e.what(); \
+    } \
+    if (!caught) throw hoytech::error(#condition, " | expected error, but didn't get one (", expected, ")"); \
+    if (errorMsg.find(expected) == std::string::npos) throw hoytech::error(#condition, " | error msg not what we expected: ", errorMsg, " (not ", expected, ")"); \
+}
+
+
+// Hash indices only support exact-match lookups, so no range/ordered APIs are generated for them
+
+template<typename Env>
+concept HasOrderedEmailLC = requires(Env &env, lmdb::txn &txn) {
+    env.foreachKey_Person__emailLC(txn, [](auto){ return true; });
+};
+
+template<typename Env>
+concept HasRangeScanEmailLC = requires(Env &env, lmdb::txn &txn) {
+    env.foreach_Person__emailLC(txn, [](auto &){ return true; });
+};
+
+static_assert(!HasOrderedEmailLC<example::environment>);
+static_assert(!HasRangeScanEmailLC<example::environment>);
+
+
+
+// Recreates the rows example_test.cpp leaves behind, so the cases below can be written against
+// the same data without repeating the whole baseline suite
+
+static void populate(example::environment &env) {
+    auto txn = env.txn_rw();
+
+    env.insert_User(txn, "john", "\x01\x02\x03", 1000); // 1
+    env.insert_User(txn, "jane", "\x01\x02\x03", 1001); // 2
+    env.insert_User(txn, "jane2", "\x01\x02\x03", 1001); // 3
+    env.insert_User(txn, "zoya", "\xDD\xEE", 1001); // 4
+    env.insert_User(txn, "bob", "\x01\x02\x03", 1500); // 5
+    env.insert_User(txn, "bob2", "\xFF", 1001); // 6
+    env.insert_User(txn, "", "", 0); // 7
+    env.delete_User(txn, 3);
+    env.delete_User(txn, 7);
+
+    env.insert_Person(txn, "John", "john@GMAIL.COM", 20, "user");
+    env.insert_Person(txn, "john", "John@Yahoo.Com", 30, "user");
+    env.insert_Person(txn, "alice", "alice@gmail.com", 5, "user");
+    env.insert_Person(txn, "sam", "sam@gmail.com", 40, "admin");
+
+    env.insert_Phrase(txn, "the quick brown"); // 1
+    env.insert_Phrase(txn, "fox jumped over"); // 2
+    env.insert_Phrase(txn, "a quick but lazy"); // 3
+    env.insert_Phrase(txn, "dog"); // 4
+    env.insert_Phrase(txn, "one more quick"); // 5
+    env.delete_Phrase(txn, 3);
+
+    env.insert_SomeRecord(txn, 53, "b");
+    env.insert_SomeRecord(txn, 99, "f");
+    env.insert_SomeRecord(txn, 70, "d");
+    env.insert_SomeRecord(txn, 60, "c");
+    env.insert_SomeRecord(txn, 75, "e");
+    env.insert_SomeRecord(txn, 50, "a");
+
+    env.insert_MultiRecs(txn, { "hello", "world" }, { "\xFF\xEE", "\xF5\xF5" }, { 3, 4 }); // 1
+
+    {
+        std::vector<std::string> strs = { "goodbye", "world" };
+        env.insert_MultiRecs(txn, env.views(strs), { "\xF5\xF5" }, { 4, 5, 6 }); // 2
+    }
+
+    env.delete_MultiRecs(txn, 1);
+
+    env.insert_NullIndices(txn, "", 0); // 1
+    env.insert_NullIndices(txn, "a", 1); // 2
+
+    env.insert_CustomComp(txn, "bbbb", 1001); // 1
+    env.insert_CustomComp(txn, "aaaa", 1234);
+    env.insert_CustomComp(txn, "bbbb", 1000); // 3
+    env.insert_CustomComp(txn, "bbbb", 1050); // 4
+    env.insert_CustomComp(txn, "aaaa", 1234);
+    env.insert_CustomComp(txn, "bbbb", 1002); // 6
+    env.insert_CustomComp(txn, "bbbb", 997); // 7
+    env.insert_CustomComp(txn, "bbbb", 999); // 8
+    env.insert_CustomComp(txn, "cccc", 1234);
+
+    env.insert_MyOpaqueTable(txn, 2, "A\x07\x20");
+    env.insert_MyOpaqueTable(txn, 1, "CC\x20");
+    env.insert_MyOpaqueTable(txn, 3, "BB\x21");
+    env.insert_MyOpaqueTable(txn, 5, "DD\x22\x05\x06\x07");
+    env.insert_MyOpaqueTable(txn, 9, "BB\x23\x07\x08\x09");
+    env.insert_MyOpaqueTable(txn, 8, "DD\x23");
+    env.delete_MyOpaqueTable(txn, 3);
+
+    env.insert_MyOpaqueTableAutoPrimary(txn, "1111");
+    env.insert_MyOpaqueTableAutoPrimary(txn, "2222");
+    env.insert_MyOpaqueTableAutoPrimary(txn, "3333");
+    env.insert_MyOpaqueTableAutoPrimary(txn, "4444");
+    env.delete_MyOpaqueTableAutoPrimary(txn, 2);
+
+    txn.commit();
+}
+
+
+
+int main() {
+    example::environment env;
+
+    verify(system("mkdir -p db/pending/") == 0);
+    verify(system("rm -f db/pending/data.mdb") == 0);
+
+    env.open("db/pending/");
+
+    populate(env);
+
+
+
+    // Hash index stores fixed-width keys
+
+    {
+        auto txn = env.txn_ro();
+
+        auto cursor = lmdb::cursor::open(txn, env.dbi_Person__emailLC);
+        std::string_view k, v;
+        uint64_t count = 0;
+
+        for (bool found = cursor.get(k, v, MDB_FIRST); found; found = cursor.get(k, v, MDB_NEXT)) {
+            verify(k.size() == 8);
+            count++;
+        }
+
+        verify(count == 4);
+        verify(env.hashKey_Person__emailLC("john@gmail.com").size() == 8);
+    }
+
+    // Hash collisions are resolved by checking the row
+
+    {
+        auto txn = env.txn_rw();
+
+        for (int i = 0; i < 50; i++) env.insert_HashCollide(txn, std::string("code") + std::to_string(i)); // 1..50
+
+        for (int i = 0; i < 50; i++) {
+            auto view = env.lookup_HashCollide__code(txn, std::string("code") + std::to_string(i));
+            verify(view);
+            verify(view->primaryKeyId == (uint64_t)i + 1);
+        }
+
+        verify(!env.lookup_HashCollide__code(txn, "code50"));
+
+        // Only a true duplicate violates uniqueness, not a colliding hash
+
+        verifyThrow(env.insert_HashCollide(txn, "code7"), "unique constraint violated: HashCollide.code");
+        env.insert_HashCollide(txn, "code50"); // 51
+
+        env.delete_HashCollide(txn, 8); // code7
+        verify(!env.lookup_HashCollide__code(txn, "code7"));
+
+        for (int i = 0; i < 51; i++) {
+            if (i == 7) continue;
+            verify(env.lookup_HashCollide__code(txn, std::string("code") + std::to_string(i)));
+        }
+
+        auto view = env.lookup_HashCollide__code(txn, "code3");
+        env.update_HashCollide(txn, *view, { .code = "code7" });
+        verify(env.lookup_HashCollide__code(txn, "code7")->primaryKeyId == 4);
+        verify(!env.lookup_HashCollide__code(txn, "code3"));
+
+        txn.commit();
+    }
+
+
+
+    // Dictionary fields: codes assigned in order of first use, strings shared from the cached dictionary
+
+    {
+        auto txn = env.txn_ro();
+
+        verify(env.dictCode_Person__role(txn, "user") == 1);
+        verify(env.dictCode_Person__role(txn, "admin") == 2);
+        verify(!env.dictCode_Person__role(txn, "moderator"));
+
+        auto v1 = env.lookup_Person(txn, 1);
+        auto v4 = env.lookup_Person(txn, 4);
+        auto v2 = env.lookup_Person(txn, 2);
+
+        verify(v1->role() == "user");
+        verify(v4->role() == "admin");
+        verify(v1->roleCode() == 1);
+        verify(v4->roleCode() == 2);
+        verify(v1->role().data() == v2->role().data());
+    }
+
+    {
+        auto txn = env.txn_ro();
+
+        std::vector<uint64_t> ids;
+
+        env.foreachDup_Person__role(txn, "user", [&](auto &view){
+            ids.push_back(view.primaryKeyId);
+            return true;
+        });
+
+        verify(ids == std::vector<uint64_t>({1, 2, 3}));
+
+        // Unknown string has no code, so no index lookup
+
+        ids.clear();
+
+        env.foreachDup_Person__role(txn, "moderator", [&](auto &view){
+            ids.push_back(view.primaryKeyId);
+            return true;
+        });
+
+        verify(ids.empty());
+    }
+
+    // New dictionary entries from an aborted txn must not leak into the cache
+
+    {
+        auto txn = env.txn_rw();
+        env.insert_Person(txn, "ghost", "ghost@example.com", 50, "ghostrole");
+        verify(env.dictCode_Person__role(txn, "ghostrole") == 3);
+        txn.abort();
+    }
+
+    {
+        auto txn = env.txn_ro();
+        verify(!env.dictCode_Person__role(txn, "ghostrole"));
+    }
+
+    // Index is ordered by code, not by string
+
+    {
+        auto txn = env.txn_rw();
+        env.insert_Person(txn, "mod", "mod@example.com", 25, "moderator"); // 5
+        auto view = env.lookup_Person(txn, 3);
+        env.update_Person(txn, *view, { .role = "moderator" });
+        txn.commit();
+    }
+
+    {
+        auto txn = env.txn_ro();
+
+        verify(env.dictCode_Person__role(txn, "moderator") == 3);
+
+        std::vector<std::string> keys;
+
+        env.foreachKey_Person__role(txn, [&](auto key){
+            keys.push_back(std::string(key));
+            return true;
+        });
+
+        verify(keys == std::vector<std::string>({"user", "moderator"}));
+
+        std::vector<uint64_t> ids;
+
+        env.foreach_Person__role(txn, [&](auto &view){
+            ids.push_back(view.primaryKeyId);
+            return true;
+        });
+
+        verify(ids == std::vector<uint64_t>({1, 2, 3, 5}));
+    }
+
+    {
+        auto txn = env.txn_rw();
+        env.delete_Person(txn, 5);
+        auto view = env.lookup_Person(txn, 3);
+        env.update_Person(txn, *view, { .role = "user" });
+        txn.commit();
+    }
+
+
+
+    // Full-text index
+
+    auto searchAll = [&](auto &txn, std::vector<std::string> terms){
+        std::vector<uint64_t> ids;
+
+        env.searchAll_Phrase__terms(txn, terms, [&](auto &view){
+            ids.push_back(view.primaryKeyId);
+            return true;
+        });
+
+        return ids;
+    };
+
+    auto searchAny = [&](auto &txn, std::vector<std::string> terms){
+        std::vector<uint64_t> ids;
+
+        env.searchAny_Phrase__terms(txn, terms, [&](auto &view){
+            ids.push_back(view.primaryKeyId);
+            return true;
+        });
+
+        return ids;
+    };
+
+    {
+        auto txn = env.txn_ro();
+
+        verify(searchAll(txn, {"quick"}) == std::vector<uint64_t>({1, 5}));
+        verify(searchAll(txn, {"quick", "the"}) == std::vector<uint64_t>({1}));
+        verify(searchAll(txn, {"quick", "fox"}) == std::vector<uint64_t>({}));
+        verify(searchAll(txn, {"quick", "nonexistent"}) == std::vector<uint64_t>({}));
+        verify(searchAll(txn, {"lazy"}) == std::vector<uint64_t>({})); // only in deleted row 3
+
+        verify(searchAny(txn, {"quick", "dog"}) == std::vector<uint64_t>({1, 4, 5}));
+        verify(searchAny(txn, {"fox", "nonexistent"}) == std::vector<uint64_t>({2}));
+        verify(searchAny(txn, {}) == std::vector<uint64_t>({}));
+
+        verify(env.docCount_Phrase__terms(txn, "quick") == 2);
+        verify(env.docCount_Phrase__terms(txn, "lazy") == 0);
+    }
+
+    // Repeated term within one row is posted once
+
+    {
+        auto txn = env.txn_rw();
+
+        env.insert_Phrase(txn, "dog eat dog"); // 6
+        verify(env.docCount_Phrase__terms(txn, "dog") == 2);
+        verify(searchAll(txn, {"dog", "eat"}) == std::vector<uint64_t>({6}));
+
+        // Update moves the row between posting lists
+
+        auto view = env.lookup_Phrase(txn, 6);
+        env.update_Phrase(txn, *view, { .words = "quick cat" });
+
+        verify(searchAll(txn, {"dog"}) == std::vector<uint64_t>({4}));
+        verify(searchAll(txn, {"quick"}) == std::vector<uint64_t>({1, 5, 6}));
+        verify(searchAll(txn, {"quick", "cat"}) == std::vector<uint64_t>({6}));
+
+        env.delete_Phrase(txn, 6);
+
+        verify(searchAll(txn, {"cat"}) == std::vector<uint64_t>({}));
+        verify(searchAll(txn, {"quick"}) == std::vector<uint64_t>({1, 5}));
+
+        txn.abort();
+    }
+
+    // Large posting lists span several blocks, so intersection has to use skip pointers
+
+    {
+        auto txn = env.txn_rw();
+
+        std::vector<uint64_t> expectedAnd, expectedRareOr;
+
+        for (uint64_t i = 0; i < 20000; i++) {
+            std::string words = "common";
+            if (i % 7 == 0) words += " seven";
+            if (i % 1000 == 0) words += " thousand";
+            auto id = env.insert_Phrase(txn, words);
+
+            if (i % 7 == 0 && i % 1000 == 0) expectedAnd.push_back(id);
+            if (i % 7 == 0 || i % 1000 == 0) expectedRareOr.push_back(id);
+        }
+
+        verify(env.docCount_Phrase__terms(txn, "common") == 20000);
+        verify(searchAll(txn, {"seven", "thousand"}) == expectedAnd);
+        verify(searchAll(txn, {"common", "seven", "thousand"}) == expectedAnd);
+        verify(searchAny(txn, {"seven", "thousand"}) == expectedRareOr);
+
+        // Early stop
+
+        uint64_t seen = 0;
+
+        env.searchAll_Phrase__terms(txn, {"common", "seven"}, [&](auto &view){
+            return ++seen < 10;
+        });
+
+        verify(seen == 10);
+
+        txn.abort();
+    }
+
+
+
+    // Versioned records: fields added in v2 have defaults when reading v1 records
+
+    {
+        auto txn = env.txn_ro();
+        auto view = env.lookup_SomeRecord(txn, 53);
+
+        verify(view->_version() == 2);
+        verify(view->tag() == "none");
+        verify(view->score() == 7);
+    }
+
+    {
+        auto txn = env.txn_rw();
+
+        // Simulate rows written by a binary built from the v1 schema
+
+        for (uint64_t id = 200; id < 450; id++) {
+            env.dbi_SomeRecord.put(txn, lmdb::to_sv<uint64_t>(id), env.encodeLegacy_SomeRecord_v1(id, "old" + std::to_string(id)));
+        }
+
+        txn.commit();
+    }
+
+    {
+        auto txn = env.txn_ro();
+        auto view = env.lookup_SomeRecord(txn, 201);
+
+        verify(view);
+        verify(view->_version() == 1);
+        verify(view->junk() == "old201");
+        verify(view->tag() == "none");
+        verify(view->score() == 7);
+    }
+
+    // Any write upgrades the record in place
+
+    {
+        auto txn = env.txn_rw();
+        auto view = env.lookup_SomeRecord(txn, 201);
+        env.update_SomeRecord(txn, *view, { .junk = "new201" });
+        txn.commit();
+    }
+
+    {
+        auto txn = env.txn_ro();
+        auto view = env.lookup_SomeRecord(txn, 201);
+
+        verify(view->_version() == 2);
+        verify(view->junk() == "new201");
+        verify(view->tag() == "none");
+        verify(view->score() == 7);
+
+        verify(env.lookup_SomeRecord(txn, 202)->_version() == 1);
+    }
+
+    // Background migration in bounded batches, resumable across txns
+
+    {
+        uint64_t batches = 0, migrated = 0;
+        std::optional<uint64_t> resumeFrom;
+
+        do {
+            auto txn = env.txn_rw();
+            auto res = env.migrateBatch_SomeRecord(txn, 100, resumeFrom);
+            txn.commit();
+
+            verify(res.migrated <= 100);
+            migrated += res.migrated;
+            resumeFrom = res.nextId;
+            batches++;
+        } while (resumeFrom);
+
+        verify(migrated == 249); // 201 was already upgraded
+        verify(batches == 3);
+    }
+
+    {
+        auto txn = env.txn_rw();
+
+        uint64_t v1 = 0;
+
+        env.foreach_SomeRecord(txn, [&](auto &view){
+            if (view._version() != 2) v1++;
+            return true;
+        });
+
+        verify(v1 == 0);
+        verify(env.lookup_SomeRecord(txn, 449)->junk() == "old449");
+
+        // Second pass has nothing to do
+
+        auto res = env.migrateBatch_SomeRecord(txn, 100, std::nullopt);
+        verify(res.migrated == 0);
+        verify(!res.nextId);
+
+        txn.abort();
+    }
+
+    {
+        auto txn = env.txn_rw();
+        env.deleteRange_SomeRecord(txn, 200, 450);
+        txn.commit();
+    }
+
+    // Range deletes by primary key: [fromId, toId)
+
+    {
+        auto txn = env.txn_rw();
+
+        verify(env.deleteRange_SomeRecord(txn, 55, 75) == 2);
+        verify(env.deleteRange_SomeRecord(txn, 55, 75) == 0);
+        verify(env.deleteRange_SomeRecord(txn, 99, 1000) == 1);
+
+        std::vector<uint64_t> ids;
+
+        env.foreach_SomeRecord(txn, [&](auto &view){
+            ids.push_back(view.primaryKeyId);
+            return true;
+        });
+
+        verify(ids == std::vector<uint64_t>({50, 53, 75}));
+
+        txn.abort();
+    }
+
+    // Range deletes by index: rows not present in the index are untouched, all other indices cleaned up
+
+    {
+        auto txn = env.txn_rw();
+
+        verify(env.deleteWhere_Person__age(txn, 18, 31) == 2);
+
+        verify(!env.lookup_Person(txn, 1));
+        verify(!env.lookup_Person(txn, 2));
+        verify(env.lookup_Person(txn, 3)); // age 5, not indexed
+        verify(!env.lookup_Person__emailLC(txn, "john@gmail.com"));
+        verify(!env.lookup_Person__emailLC(txn, "john@yahoo.com"));
+
+        std::vector<std::string> keys;
+
+        env.foreachKey_Person__fullNameLC(txn, [&](auto key){
+            keys.push_back(std::string(key));
+            return true;
+        });
+
+        verify(keys == std::vector<std::string>({"alice", "sam"}));
+
+        std::vector<uint64_t> ids;
+
+        env.foreach_Person__role(txn, [&](auto &view){
+            ids.push_back(view.primaryKeyId);
+            return true;
+        });
+
+        verify(ids == std::vector<uint64_t>({3}));
+
+        txn.abort();
+    }
+
+    {
+        auto txn = env.txn_rw();
+
+        verify(env.deleteWhere_User__userName(txn, "bob", "john") == 3); // bob, bob2, jane
+
+        std::vector<uint64_t> ids;
+
+        env.foreach_User(txn, [&](auto &view){
+            ids.push_back(view.primaryKeyId);
+            return true;
+        });
+
+        verify(ids == std::vector<uint64_t>({1, 4}));
+
+        ids.clear();
+
+        env.foreach_User__created(txn, [&](auto &view){
+            ids.push_back(view.primaryKeyId);
+            return true;
+        });
+
+        verify(ids == std::vector<uint64_t>({1, 4}));
+
+        txn.abort();
+    }
+
+    // Truncate drops the table and all its index DBIs, multi and fulltext included
+
+    {
+        auto txn = env.txn_rw();
+
+        env.truncate_Phrase(txn);
+
+        uint64_t count = 0;
+
+        env.foreach_Phrase(txn, [&](auto &view){
+            count++;
+            return true;
+        });
+
+        env.foreachDup_Phrase__splitWords(txn, "quick", [&](auto &view){
+            count++;
+            return true;
+        });
+
+        env.searchAny_Phrase__terms(txn, {"quick", "dog"}, [&](auto &view){
+            count++;
+            return true;
+        });
+
+        verify(count == 0);
+
+        env.insert_Phrase(txn, "after truncate");
+        verify(env.lookup_Phrase__splitWords(txn, "truncate"));
+
+        txn.abort();
+    }
+
+
+
+    // Fixed-width arrays are exposed as aligned spans
+
+    {
+        auto txn = env.txn_ro();
+
+        auto view = env.lookup_MultiRecs(txn, 2);
+
+        std::span<const uint64_t> ints = view->ints();
+
+        verify(ints.size() == 3);
+        verify(ints[0] == 4 && ints[1] == 5 && ints[2] == 6);
+        verify(reinterpret_cast<uintptr_t>(ints.data()) % 8 == 0);
+    }
+
+    {
+        auto txn = env.txn_rw();
+
+        std::vector<float> vec;
+        for (int i = 0; i < 19; i++) vec.push_back(i * 0.5f);
+
+        env.insert_Embedding(txn, "a", vec, { 1, 2, 3 }, { 0.25, -1.0 }); // 1
+        env.insert_Embedding(txn, "bb", { 1.0f }, { }, { 3.5 }); // 2
+        env.insert_Embedding(txn, "ccc", { }, { 7 }, { }); // 3
+
+        txn.commit();
+    }
+
+    {
+        auto txn = env.txn_ro();
+
+        auto checkAlignment = [&](auto &view){
+            verify(reinterpret_cast<uintptr_t>(view.vec().data()) % 32 == 0);
+            verify(reinterpret_cast<uintptr_t>(view.hist().data()) % 4 == 0);
+            verify(reinterpret_cast<uintptr_t>(view.weights().data()) % 16 == 0);
+        };
+
+        auto view = env.lookup_Embedding(txn, 1);
+        verify(view);
+        checkAlignment(*view);
+
+        std::span<const float> vec = view->vec();
+        std::span<const uint32_t> hist = view->hist();
+        std::span<const double> weights = view->weights();
+
+        verify(vec.size() == 19);
+        verify(vec[18] == 9.0f);
+        verify(hist.size() == 3 && hist[2] == 3);
+        verify(weights.size() == 2 && weights[0] == 0.25 && weights[1] == -1.0);
+
+        // Record start varies with the preceding string length, the padding has to absorb that
+
+        env.foreach_Embedding__label(txn, [&](auto &view){
+            checkAlignment(view);
+            return true;
+        });
+
+        view = env.lookup_Embedding(txn, 3);
+        verify(view->vec().empty());
+        verify(view->hist()[0] == 7);
+    }
+
+    // LMDB only aligns node data to 2 bytes, so a payload that lands misaligned is copied into a per-view
+    // buffer and the span is not zero-copy. Records on overflow pages start 16 bytes into a page, so there
+    // arrays with align <= 16 are always read in place.
+
+    {
+        auto txn = env.txn_rw();
+        env.insert_Embedding(txn, "big", { 1.0f, 2.0f }, { }, std::vector<double>(2000, 1.5)); // 4, 16000 bytes of weights
+        txn.commit();
+    }
+
+    {
+        auto txn = env.txn_ro();
+
+        auto view = env.lookup_Embedding(txn, 4);
+        auto weights = view->weights();
+
+        verify(weights.size() == 2000 && weights[1999] == 1.5);
+        assert_zerocopy(env.lmdb_env.get_internal_map(), std::string_view(reinterpret_cast<const char*>(weights.data()), weights.size_bytes()));
+
+        // align: 32 isn't guaranteed even here, but the span is always aligned, copied or not
+
+        verify(reinterpret_cast<uintptr_t>(view->vec().data()) % 32 == 0);
+        verify(view->vec()[1] == 2.0f);
+    }
+
+    {
+        auto txn = env.txn_rw();
+        env.delete_Embedding(txn, 4);
+        txn.commit();
+    }
+
+
+
+    // Bitmap indices
+
+    {
+        auto txn = env.txn_rw();
+
+        env.insert_Tagged(txn, "red", { 1, 2 }); // 1
+        env.insert_Tagged(txn, "blue", { 2 }); // 2
+        env.insert_Tagged(txn, "red", { 2, 3 }); // 3
+        env.insert_Tagged(txn, "green", { }); // 4
+        env.insert_Tagged(txn, "red", { 3 }); // 5
+        env.insert_Tagged(txn, "blue", { 1, 3 }); // 6
+
+        txn.commit();
+    }
+
+    {
+        auto txn = env.txn_ro();
+
+        auto red = env.bitmap_Tagged__color(txn, "red");
+        auto blue = env.bitmap_Tagged__color(txn, "blue");
+        auto tag2 = env.bitmap_Tagged__tags(txn, 2);
+        auto tag3 = env.bitmap_Tagged__tags(txn, 3);
+
+        verify(red.cardinality() == 3);
+        verify(env.bitmap_Tagged__color(txn, "purple").cardinality() == 0);
+
+        verify(red.ids() == std::vector<uint64_t>({1, 3, 5}));
+        verify((red & tag2).ids() == std::vector<uint64_t>({1, 3}));
+        verify((red | blue).ids() == std::vector<uint64_t>({1, 2, 3, 5, 6}));
+        verify(red.andNot(tag3).ids() == std::vector<uint64_t>({1}));
+        verify((tag2 & tag3).cardinality() == 1);
+
+        std::vector<uint64_t> ids;
+
+        env.foreachIn_Tagged(txn, red & tag3, [&](auto &view){
+            verify(view.color() == "red");
+            ids.push_back(view.primaryKeyId);
+            return true;
+        });
+
+        verify(ids == std::vector<uint64_t>({3, 5}));
+    }
+
+    // MultiRecs.ints is bitmap-backed, so foreachDup over it walks the bitmap
+
+    {
+        auto txn = env.txn_ro();
+
+        std::vector<uint64_t> ids;
+
+        env.foreachDup_MultiRecs__ints(txn, 4, [&](auto &view){
+            ids.push_back(view.primaryKeyId);
+            return true;
+        });
+
+        verify(ids == std::vector<uint64_t>({2}));
+        verify(env.bitmap_MultiRecs__ints(txn, 3).cardinality() == 0); // only record 1 had 3, and it was deleted
+    }
+
+    // foreachDup iterates set bits in order, honouring reverse and starting point
+
+    {
+        auto txn = env.txn_ro();
+
+        std::vector<uint64_t> ids;
+        uint64_t total;
+
+        env.foreachDup_Tagged__color(txn, "red", [&](auto &view){
+            ids.push_back(view.primaryKeyId);
+            return true;
+        }, false, std::nullopt, &total);
+
+        verify(ids == std::vector<uint64_t>({1, 3, 5}));
+        verify(total == 3);
+
+        ids.clear();
+
+        env.foreachDup_Tagged__color(txn, "red", [&](auto &view){
+            ids.push_back(view.primaryKeyId);
+            return true;
+        }, true, 4);
+
+        verify(ids == std::vector<uint64_t>({3, 1}));
+    }
+
+    // Updates and deletes clear the old bits
+
+    {
+        auto txn = env.txn_rw();
+
+        auto view = env.lookup_Tagged(txn, 3);
+        env.update_Tagged(txn, *view, { .color = "blue" });
+        env.delete_Tagged(txn, 5);
+
+        verify(env.bitmap_Tagged__color(txn, "red").ids() == std::vector<uint64_t>({1}));
+        verify(env.bitmap_Tagged__color(txn, "blue").ids() == std::vector<uint64_t>({2, 3, 6}));
+        verify(env.bitmap_Tagged__tags(txn, 3).ids() == std::vector<uint64_t>({3, 6}));
+
+        txn.commit();
+    }
+
+    // Bitmaps spanning several 2^16 containers are chunked across LMDB values
+
+    {
+        auto txn = env.txn_rw();
+
+        uint64_t expectedBoth = 0;
+
+        for (uint64_t i = 0; i < 200000; i++) {
+            bool odd = i % 2, third = i % 3 == 0;
+            env.insert_Tagged(txn, odd ? "odd" : "even", third ? std::vector<uint64_t>({ 100 }) : std::vector<uint64_t>({}));
+            if (odd && third) expectedBoth++;
+        }
+
+        auto odd = env.bitmap_Tagged__color(txn, "odd");
+        auto third = env.bitmap_Tagged__tags(txn, 100);
+
+        verify(odd.cardinality() == 100000);
+        verify((odd & third).cardinality() == expectedBoth);
+        verify((odd | third).cardinality() == 100000 + 66667 - expectedBoth);
+
+        uint64_t prev = 0, count = 0;
+
+        env.foreachDup_Tagged__color(txn, "odd", [&](auto &view){
+            verify(view.primaryKeyId > prev);
+            prev = view.primaryKeyId;
+            count++;
+            return true;
+        });
+
+        verify(count == 100000);
+
+        txn.abort();
+    }
+
+
+
+    // Primary key allocator: IDs are never reused, even after deleting the highest one
+
+    {
+        auto txn = env.txn_rw();
+
+        env.delete_MyOpaqueTableAutoPrimary(txn, 4);
+        verify(env.insert_MyOpaqueTableAutoPrimary(txn, "5555") == 5);
+        verify(env.insert_MyOpaqueTableAutoPrimary(txn, "6666") == 6);
+
+        txn.commit();
+    }
+
+    // Allocations from an aborted txn are rolled back
+
+    {
+        auto txn = env.txn_rw();
+        verify(env.insert_MyOpaqueTableAutoPrimary(txn, "7777") == 7);
+        txn.abort();
+    }
+
+    {
+        auto txn = env.txn_rw();
+        verify(env.insert_MyOpaqueTableAutoPrimary(txn, "7777") == 7);
+        txn.commit();
+    }
+
+    // Block reservation: reserve in a short txn, build off-lock, insert later
+
+    {
+        uint64_t first;
+
+        {
+            auto txn = env.txn_rw();
+            first = env.reserveIds_MyOpaqueTableAutoPrimary(txn, 100);
+            verify(first == 8);
+            txn.commit();
+        }
+
+        {
+            auto txn = env.txn_rw();
+            verify(env.insert_MyOpaqueTableAutoPrimary(txn, "after block") == 108);
+            txn.commit();
+        }
+
+        std::vector<std::string> bufs;
+        for (uint64_t i = 0; i < 100; i++) bufs.push_back(std::string("reserved ") + std::to_string(first + i));
+
+        {
+            auto txn = env.txn_rw();
+
+            for (uint64_t i = 99; i > 0; i--) env.insertReserved_MyOpaqueTableAutoPrimary(txn, first + i, bufs[i]);
+            env.insertReserved_MyOpaqueTableAutoPrimary(txn, first, bufs[0]);
+
+            verifyThrow(env.insertReserved_MyOpaqueTableAutoPrimary(txn, first, "x"), "duplicate insert into");
+            verifyThrow(env.insertReserved_MyOpaqueTableAutoPrimary(txn, 500, "x"), "id not reserved");
+
+            txn.commit();
+        }
+
+        auto txn = env.txn_ro();
+
+        auto view = env.lookup_MyOpaqueTableAutoPrimary(txn, first + 50);
+        verify(view);
+        verify(view->buf == "reserved 58");
+
+        auto view2 = env.lookup_MyOpaqueTableAutoPrimary__someStr(txn, "reserved 8");
+        verify(view2);
+        verify(view2->primaryKeyId == 8);
+    }
+
+    // Allocator state is persisted in the metadata DBI across environment reopens
+
+    {
+        verify(system("mkdir -p db/ids/") == 0);
+        verify(system("rm -f db/ids/data.mdb") == 0);
+
+        {
+            example::environment idsEnv;
+            idsEnv.open("db/ids/");
+
+            auto txn = idsEnv.txn_rw();
+            idsEnv.insert_MyOpaqueTableAutoPrimary(txn, "a"); // 1
+            idsEnv.insert_MyOpaqueTableAutoPrimary(txn, "b"); // 2
+            idsEnv.delete_MyOpaqueTableAutoPrimary(txn, 2);
+            txn.commit();
+        }
+
+        {
+            example::environment idsEnv;
+            idsEnv.open("db/ids/");
+
+            auto txn = idsEnv.txn_rw();
+            verify(idsEnv.insert_MyOpaqueTableAutoPrimary(txn, "c") == 3);
+            txn.commit();
+        }
+    }
+
+
+
+    // Map size growth: start with a tiny map and let a bulk load grow it
+
+    {
+        example::environment growEnv;
+
+        verify(system("mkdir -p db/grow/") == 0);
+        verify(system("rm -f db/grow/data.mdb") == 0);
+
+        growEnv.open("db/grow/", {
+            .mapSize = 1 * 1024 * 1024,
+            .mapSizeGrowthFactor = 2,
+            .mapSizeMax = 64 * 1024 * 1024,
+            .mapSizeFreeThreshold = 0.25,
+        });
+
+        verify(growEnv.mapSize() == 1 * 1024 * 1024);
+
+        // Single transaction larger than the initial map: fails with MDB_MAP_FULL, map grows, callback is re-run
+
+        uint64_t attempts = 0;
+
+        growEnv.writeTxn([&](auto &txn){
+            attempts++;
+            for (uint64_t i = 0; i < 2000; i++) {
+                growEnv.insert_User(txn, std::string("user") + std::to_string(i), std::string(1000, 'x'), i);
+            }
+        });
+
+        verify(attempts > 1);
+        verify(growEnv.mapSize() > 1 * 1024 * 1024);
+        verify(growEnv.mapSize() <= 64 * 1024 * 1024);
+
+        {
+            auto txn = growEnv.txn_ro();
+
+            uint64_t total = 0;
+
+            growEnv.foreach_User__userName(txn, [&](auto &view){
+                return false;
+            }, false, std::nullopt, &total);
+
+            verify(total == 2000);
+
+            auto view = growEnv.lookup_User__userName(txn, "user1999");
+            verify(view);
+            verify(view->created() == 1999);
+        }
+
+        // Growth is capped at mapSizeMax, after which MDB_MAP_FULL propagates
+
+        verifyThrow(growEnv.writeTxn([&](auto &txn){
+            for (uint64_t i = 0; i < 100000; i++) {
+                growEnv.insert_User(txn, std::string("big") + std::to_string(i), std::string(4000, 'y'), i);
+            }
+        }), "MDB_MAP_FULL");
+
+        verify(growEnv.mapSize() == 64 * 1024 * 1024);
+
+        // Failed attempts were aborted, so nothing from them was committed
+
+        {
+            auto txn = growEnv.txn_ro();
+            verify(!growEnv.lookup_User__userName(txn, "big0"));
+        }
+    }
+
+    // Free-space threshold: starting a write txn with less than 25% of the map free grows it up front
+
+    {
+        verify(system("mkdir -p db/grow-threshold/") == 0);
+        verify(system("rm -f db/grow-threshold/data.mdb") == 0);
+
+        uint64_t filledSize;
+
+        // Fill with the threshold disabled, in txns small enough to never hit MDB_MAP_FULL
+
+        {
+            example::environment growEnv;
+            growEnv.open("db/grow-threshold/", { .mapSize = 1 * 1024 * 1024, .mapSizeFreeThreshold = 0 });
+
+            for (uint64_t i = 0; growEnv.mapFree() >= 0.2; i++) {
+                auto txn = growEnv.txn_rw();
+                growEnv.insert_User(txn, std::string("fill") + std::to_string(i), std::string(1000, 'x'), i);
+                txn.commit();
+            }
+
+            filledSize = growEnv.mapSize();
+            verify(filledSize == 1 * 1024 * 1024);
+        }
+
+        {
+            example::environment growEnv;
+            growEnv.open("db/grow-threshold/", {
+                .mapSize = filledSize,
+                .mapSizeGrowthFactor = 2,
+                .mapSizeMax = 64 * 1024 * 1024,
+                .mapSizeFreeThreshold = 0.25,
+            });
+
+            verify(growEnv.mapSize() == filledSize);
+            verify(growEnv.mapFree() < 0.25);
+
+            {
+                auto txn = growEnv.txn_rw();
+                verify(growEnv.mapSize() == 2 * filledSize);
+                verify(growEnv.mapFree() >= 0.25);
+            }
+
+            // Read txns never resize the map
+
+            uint64_t grown = growEnv.mapSize();
+            auto txn = growEnv.txn_ro();
+            verify(growEnv.mapSize() == grown);
+        }
+    }
+
+
+
+    // Compressed fields
+
+    std::string longBody;
+    for (int i = 0; i < 500; i++) longBody += "lorem ipsum dolor sit amet ";
+
+    std::string longAttachment(20000, '\xAB');
+
+    {
+        auto txn = env.txn_rw();
+
+        env.insert_CompressedDoc(txn, "short", "tiny body", "\x01\x02"); // 1
+        env.insert_CompressedDoc(txn, "long", longBody, longAttachment); // 2
+
+        txn.commit();
+    }
+
+    {
+        auto txn = env.txn_ro();
+        auto view = env.lookup_CompressedDoc(txn, 1);
+
+        verify(view);
+        verify(view->title() == "short");
+
+        // Below minSize: stored raw, accessor still zero-copy and scratch buffer untouched
+
+        std::string scratch;
+        auto before = env.compressionStats().decompressions;
+
+        verify(!view->bodyIsCompressed());
+        verify(view->body(scratch) == "tiny body");
+        verify(scratch.empty());
+        assert_zerocopy(env.lmdb_env.get_internal_map(), view->body(scratch));
+
+        verify(view->attachment(scratch) == "\x01\x02");
+        verify(env.compressionStats().decompressions == before);
+    }
+
+    {
+        auto txn = env.txn_ro();
+        auto view = env.lookup_CompressedDoc(txn, 2);
+
+        verify(view);
+        verify(view->bodyIsCompressed());
+        verify(view->attachmentIsCompressed());
+
+        // Above minSize: decompressed into caller's buffer, which is reused across calls
+
+        std::string scratch;
+        auto before = env.compressionStats().decompressions;
+
+        auto body = view->body(scratch);
+        verify(body == longBody);
+        verify(body.data() == scratch.data());
+
+        auto attachment = view->attachment(scratch);
+        verify(attachment == longAttachment);
+        verify(attachment.data() == scratch.data());
+
+        verify(env.compressionStats().decompressions == before + 2);
+
+        // Stored record is much smaller than the uncompressed payload
+
+        verify(view->_str().size() < (longBody.size() + longAttachment.size()) / 4);
+    }
+
+    // Scanning without touching compressed fields never decompresses
+
+    {
+        auto txn = env.txn_ro();
+
+        std::vector<std::string> titles;
+        auto before = env.compressionStats().decompressions;
+
+        env.foreach_CompressedDoc__title(txn, [&](auto &view){
+            titles.push_back(std::string(view.title()));
+            return true;
+        });
+
+        env.foreach_CompressedDoc(txn, [&](auto &view){
+            verify(!view.title().empty());
+            return true;
+        });
+
+        verify(titles == std::vector<std::string>({"long", "short"}));
+        verify(env.compressionStats().decompressions == before);
+    }
+
+    // Update crossing the threshold in both directions
+
+    {
+        auto txn = env.txn_rw();
+
+        auto view = env.lookup_CompressedDoc(txn, 1);
+        env.update_CompressedDoc(txn, *view, { .body = longBody });
+
+        view = env.lookup_CompressedDoc(txn, 2);
+        env.update_CompressedDoc(txn, *view, { .body = "now short" });
+
+        txn.commit();
+    }
+
+    {
+        auto txn = env.txn_ro();
+        std::string scratch;
+
+        auto view = env.lookup_CompressedDoc(txn, 1);
+        verify(view->bodyIsCompressed());
+        verify(view->body(scratch) == longBody);
+
+        view = env.lookup_CompressedDoc(txn, 2);
+        verify(!view->bodyIsCompressed());
+        verify(view->body(scratch) == "now short");
+        verify(view->attachment(scratch) == longAttachment);
+    }
+
+    // Compressed opaque tables
+
+    {
+        auto txn = env.txn_rw();
+
+        env.insert_MyOpaqueCompressed(txn, "abcd" + longBody); // 1
+        env.insert_MyOpaqueCompressed(txn, "wxyz"); // 2
+
+        txn.commit();
+    }
+
+    {
+        auto txn = env.txn_ro();
+        std::string scratch;
+
+        auto view = env.lookup_MyOpaqueCompressed(txn, 1);
+        verify(view);
+        verify(view->buf(scratch) == "abcd" + longBody);
+
+        view = env.lookup_MyOpaqueCompressed(txn, 2);
+        verify(view);
+        verify(view->buf(scratch) == "wxyz");
+        assert_zerocopy(env.lmdb_env.get_internal_map(), view->buf(scratch));
+
+        // Index scans only read the index and primary key, the compressed buffer stays untouched
+
+        std::vector<uint64_t> ids;
+        auto before = env.compressionStats().decompressions;
+
+        env.foreach_MyOpaqueCompressed__someStr(txn, [&](auto &view){
+            ids.push_back(view.primaryKeyId);
+            return true;
+        });
+
+        verify(ids == std::vector<uint64_t>({1, 2}));
+        verify(env.compressionStats().decompressions == before);
+    }
+
+
+
+    // Prepared records: encoding and indexPrelude run outside the write txn
+
+    {
+        auto prepared = env.prepare_Person("Zed", "ZED@Example.com", 44, "guest");
+
+        verify(prepared.indices.fullNameLC == "zed");
+        verify(prepared.indices.emailLC == "zed@example.com");
+        verify(prepared.indices.age == 44);
+
+        auto txn = env.txn_rw();
+
+        auto id = env.insertPrepared_Person(txn, prepared);
+
+        auto view = env.lookup_Person__emailLC(txn, "zed@example.com");
+        verify(view);
+        verify(view->primaryKeyId == id);
+        verify(view->fullName() == "Zed");
+        verify(view->role() == "guest"); // dictionary code assigned at insert time, not prepare time
+        verify(env.dictCode_Person__role(txn, "guest"));
+
+        // Unique checks still happen at insert time
+
+        verifyThrow(env.insertPrepared_Person(txn, prepared), "unique constraint violated: Person.emailLC");
+
+        txn.abort();
+    }
+
+    // Prelude errors surface from prepare, before any txn is opened
+
+    verifyThrow(env.prepare_MyOpaqueTable(100, "A"), "too short");
+
+    {
+        auto prepared = env.prepare_MyOpaqueTable(1, "ZZ\x01");
+
+        auto txn = env.txn_rw();
+        verifyThrow(env.insertPrepared_MyOpaqueTable(txn, prepared), "duplicate insert into");
+    }
+
+    // Many producer threads feeding one writer
+
+    {
+        const size_t numThreads = 4, perThread = 500;
+
+        std::vector<std::vector<example::Prepared_Phrase>> batches(numThreads);
+        std::vector<std::thread> threads;
+
+        for (size_t t = 0; t < numThreads; t++) {
+            threads.emplace_back([&, t]{
+                for (size_t i = 0; i < perThread; i++) {
+                    batches[t].push_back(env.prepare_Phrase(std::string("producer") + std::to_string(t) + " item" + std::to_string(i) + " prepared"));
+                }
+            });
+        }
+
+        for (auto &t : threads) t.join();
+
+        verify(batches[2][7].indices.splitWords == std::vector<std::string>({ "producer2", "item7", "prepared" }));
+
+        auto txn = env.txn_rw();
+
+        for (auto &batch : batches) {
+            for (auto &p : batch) env.insertPrepared_Phrase(txn, p);
+        }
+
+        uint64_t total = 0;
+
+        env.foreachDup_Phrase__splitWords(txn, "prepared", [&](auto &view){
+            total++;
+            return true;
+        });
+
+        verify(total == numThreads * perThread);
+        verify(env.docCount_Phrase__terms(txn, "producer3") == perThread);
+        verify(env.lookup_Phrase__splitWords(txn, "item499"));
+
+        txn.abort();
+    }
+
+
+
+    // Pooled read txns
+
+    {
+        auto name = env.withReadTxn([&](auto &txn){
+            auto view = env.lookup_User(txn, 1);
+            verify(view);
+            return std::string(view->userName());
+        });
+
+        verify(name == "john");
+    }
+
+    // Renewed txn sees writes committed since it was last reset
+
+    {
+        env.withReadTxn([&](auto &txn){
+            verify(!env.lookup_User__userName(txn, "pooltest"));
+        });
+
+        {
+            auto txn = env.txn_rw();
+            env.insert_User(txn, "pooltest", "", 5000);
+            txn.commit();
+        }
+
+        env.withReadTxn([&](auto &txn){
+            verify(env.lookup_User__userName(txn, "pooltest"));
+        });
+    }
+
+    // Nested calls share the outer snapshot
+
+    {
+        env.withReadTxn([&](auto &outer){
+            auto outerView = env.lookup_User__userName(outer, "pooltest");
+            verify(outerView);
+
+            {
+                auto txn = env.txn_rw();
+                auto view = env.lookup_User__userName(txn, "pooltest");
+                env.delete_User(txn, view->primaryKeyId);
+                txn.commit();
+            }
+
+            env.withReadTxn([&](auto &inner){
+                verify(&inner == &outer);
+                verify(env.lookup_User__userName(inner, "pooltest"));
+            });
+        });
+
+        env.withReadTxn([&](auto &txn){
+            verify(!env.lookup_User__userName(txn, "pooltest"));
+        });
+    }
+
+    // Pooled cursors are repositioned on each use, including after a scan that stopped early
+
+    {
+        env.withReadTxn([&](auto &txn){
+            for (int i = 0; i < 3; i++) {
+                std::vector<uint64_t> ids;
+
+                env.foreach_User__userName(txn, [&](auto &view){
+                    ids.push_back(view.primaryKeyId);
+                    return ids.size() < 2;
+                });
+
+                verify(ids == std::vector<uint64_t>({5, 6}));
+
+                verify(env.lookup_User__userName(txn, "zoya")->primaryKeyId == 4);
+            }
+        });
+    }
+
+    // Exceptions thrown from the callback reset the txn and return it to the pool
+
+    {
+        verifyThrow(env.withReadTxn([&](auto &txn){
+            throw hoytech::error("callback failed");
+        }), "callback failed");
+
+        env.withReadTxn([&](auto &txn){
+            verify(env.lookup_User(txn, 1));
+        });
+    }
+
+    // Each thread has its own pool. A verify failing inside the thread would call std::terminate, so
+    // the thread only records what it saw and the checks run after join()
+
+    {
+        MDB_txn *mainHandle = nullptr, *threadHandle = nullptr;
+        std::string threadUserName, threadError;
+
+        env.withReadTxn([&](auto &txn){
+            mainHandle = txn.handle();
+
+            std::thread t([&]{
+                try {
+                    env.withReadTxn([&](auto &txn){
+                        threadHandle = txn.handle();
+                        threadUserName = std::string(env.lookup_User(txn, 1)->userName());
+                    });
+                } catch (const std::exception &e) {
+                    threadError = e.what();
+                }
+            });
+
+            t.join();
+        });
+
+        verify(threadError == "");
+        verify(threadUserName == "john");
+        verify(mainHandle && threadHandle);
+        verify(mainHandle != threadHandle);
+    }
+
+
+
+    // Coroutine scans: batches of views, suspended between batches
+
+    {
+        auto txn = env.txn_ro();
+
+        std::vector<std::vector<uint64_t>> batches;
+
+        for (auto &batch : env.co_foreach_User__created(txn, { .batchSize = 2 })) {
+            std::vector<uint64_t> ids;
+            for (auto &view : batch.views) ids.push_back(view.primaryKeyId);
+            batches.push_back(ids);
+        }
+
+        verify(batches == std::vector<std::vector<uint64_t>>({ {1, 2}, {4, 6}, {5} }));
+    }
+
+    {
+        auto txn = env.txn_ro();
+
+        std::vector<uint64_t> ids;
+
+        for (auto &batch : env.co_foreach_User__created(txn, { .batchSize = 2, .reverse = true })) {
+            for (auto &view : batch.views) ids.push_back(view.primaryKeyId);
+        }
+
+        verify(ids == std::vector<uint64_t>({5, 6, 4, 2, 1}));
+    }
+
+    // Release the snapshot mid-scan and resume later from the token with a fresh txn
+
+    {
+        example::ResumeToken_User__created token;
+
+        {
+            auto txn = env.txn_ro();
+            auto gen = env.co_foreach_User__created(txn, { .batchSize = 2 });
+
+            auto it = gen.begin();
+            verify(it != gen.end());
+
+            std::vector<uint64_t> ids;
+            for (auto &view : it->views) ids.push_back(view.primaryKeyId);
+            verify(ids == std::vector<uint64_t>({1, 2}));
+
+            token = it->resumeToken;
+            verify(token.key == 1001);
+            verify(token.primaryKeyId == 2);
+        }
+
+        uint64_t newId;
+
+        {
+            auto txn = env.txn_rw();
+            newId = env.insert_User(txn, "coro", "", 1001); // same created as 4 and 6 (bob2), sorts after both by primaryKeyId
+            env.insert_User(txn, "coro-early", "", 999); // before the token, must not be seen
+            txn.commit();
+        }
+
+        {
+            auto txn = env.txn_ro();
+
+            std::vector<uint64_t> ids;
+
+            for (auto &batch : env.co_foreach_User__created(txn, { .batchSize = 2, .resumeFrom = token })) {
+                for (auto &view : batch.views) ids.push_back(view.primaryKeyId);
+            }
+
+            verify(ids == std::vector<uint64_t>({4, 6, newId, 5}));
+        }
+
+        {
+            auto txn = env.txn_rw();
+            env.delete_User(txn, newId);
+            env.delete_User(txn, env.lookup_User__userName(txn, "coro-early")->primaryKeyId);
+            txn.commit();
+        }
+    }
+
+    // Abandoning a generator early closes its cursor
+
+    {
+        auto txn = env.txn_ro();
+
+        {
+            auto gen = env.co_foreach_User__created(txn, { .batchSize = 1 });
+            verify(gen.begin()->views.size() == 1);
+        }
+
+        verify(env.lookup_User(txn, 1));
+    }
+
+
+
+    // Columnar scans
+
+    {
+        auto txn = env.txn_ro();
+
+        std::vector<uint64_t> batchSizes, ids, ages;
+        std::vector<std::string> names;
+
+        env.scanColumns_Person(txn, { example::Column_Person::age, example::Column_Person::fullName }, 3, [&](auto &batch){
+            batchSizes.push_back(batch.size());
+
+            verify(batch.primaryKeyId.size() == batch.size());
+            verify(batch.age.size() == batch.size());
+            verify(batch.fullName.offsets.size() == batch.size() + 1);
+            verify(batch.fullName.offsets[0] == 0);
+            verify(batch.fullName.offsets[batch.size()] == batch.fullName.data.size());
+
+            // Columns not requested are left empty
+
+            verify(batch.email.offsets.empty());
+            verify(batch.roleCode.empty());
+
+            // Fixed-width columns are contiguous and aligned for SIMD
+
+            verify(reinterpret_cast<uintptr_t>(batch.age.data()) % 32 == 0);
+
+            for (size_t i = 0; i < batch.size(); i++) {
+                ids.push_back(batch.primaryKeyId[i]);
+                ages.push_back(batch.age[i]);
+                names.push_back(std::string(batch.fullName[i]));
+            }
+
+            return true;
+        });
+
+        verify(batchSizes == std::vector<uint64_t>({3, 1}));
+        verify(ids == std::vector<uint64_t>({1, 2, 3, 4}));
+        verify(ages == std::vector<uint64_t>({20, 30, 5, 40}));
+        verify(names == std::vector<std::string>({"John", "john", "alice", "sam"}));
+    }
+
+    // Dictionary fields come out as codes plus the dictionary, so no string bytes are copied
+
+    {
+        auto txn = env.txn_ro();
+
+        env.scanColumns_Person(txn, { example::Column_Person::role }, 100, [&](auto &batch){
+            verify(batch.size() == 4);
+            verify(batch.roleCode.size() == 4);
+            verify(batch.roleDict[batch.roleCode[0]] == "user");
+            verify(batch.roleDict[batch.roleCode[3]] == "admin");
+            return true;
+        });
+    }
+
+    // Early stop, and ubytes columns
+
+    {
+        auto txn = env.txn_ro();
+
+        uint64_t calls = 0;
+
+        env.scanColumns_User(txn, { example::Column_User::passwordHash }, 1, [&](auto &batch){
+            calls++;
+            verify(batch.passwordHash[0] == "\x01\x02\x03");
+            return false;
+        });
+
+        verify(calls == 1);
+    }
+
+
+
+    // Index verification and rebuild
+
+    {
+        auto report = env.verify_Person();
+        verify(report.ok());
+        verify(report.rowsChecked == 4);
+    }
+
+    // Damage the indices behind the generated code's back
+
+    {
+        auto txn = env.txn_rw();
+
+        env.dbi_Person__emailLC.del(txn, env.hashKey_Person__emailLC("john@yahoo.com"), lmdb::to_sv<uint64_t>(2));
+        env.dbi_Person__emailLC.put(txn, env.hashKey_Person__emailLC("bogus@example.com"), lmdb::to_sv<uint64_t>(3));
+        env.dbi_Person__fullNameLC.put(txn, "nobody", lmdb::to_sv<uint64_t>(99));
+
+        txn.commit();
+    }
+
+    {
+        auto report = env.verify_Person({ .threads = 4 });
+        verify(!report.ok());
+        verify(report.mismatches.size() == 3);
+
+        std::vector<std::string> found;
+
+        for (auto &m : report.mismatches) {
+            found.push_back(std::string(m.index) + " " + (m.missing ? "missing " : "extra ") + m.key + " " + std::to_string(m.primaryKeyId));
+        }
+
+        std::sort(found.begin(), found.end());
+
+        verify(found == std::vector<std::string>({
+            "emailLC extra " + env.hashKey_Person__emailLC("bogus@example.com") + " 3",
+            "emailLC missing " + env.hashKey_Person__emailLC("john@yahoo.com") + " 2",
+            "fullNameLC extra nobody 99",
+        }));
+    }
+
+    {
+        auto txn = env.txn_rw();
+        env.rebuildIndex_Person__emailLC(txn);
+        txn.commit();
+    }
+
+    {
+        auto report = env.verify_Person();
+        verify(report.mismatches.size() == 1);
+        verify(std::string_view(report.mismatches[0].index) == "fullNameLC");
+
+        auto txn = env.txn_ro();
+        verify(env.lookup_Person__emailLC(txn, "john@yahoo.com")->primaryKeyId == 2);
+        verify(!env.lookup_Person__emailLC(txn, "bogus@example.com"));
+    }
+
+    {
+        auto txn = env.txn_rw();
+        env.rebuildIndices_Person(txn);
+        txn.commit();
+    }
+
+    {
+        verify(env.verify_Person().ok());
+
+        auto txn = env.txn_ro();
+
+        std::vector<std::string> keys;
+
+        env.foreachKey_Person__fullNameLC(txn, [&](auto key){
+            keys.push_back(std::string(key));
+            return true;
+        });
+
+        verify(keys == std::vector<std::string>({"alice", "john", "sam"}));
+
+        // Rebuild re-applies the prelude: alice (under 18) stays out of age, sam (admin) stays out of role
+
+        std::vector<uint64_t> ids;
+
+        env.foreach_Person__age(txn, [&](auto &view){
+            ids.push_back(view.primaryKeyId);
+            return true;
+        });
+
+        verify(ids == std::vector<uint64_t>({1, 2, 4}));
+
+        ids.clear();
+
+        env.foreach_Person__role(txn, [&](auto &view){
+            ids.push_back(view.primaryKeyId);
+            return true;
+        });
+
+        verify(ids == std::vector<uint64_t>({1, 2, 3}));
+    }
+
+    // Multi indices are rebuilt with one entry per distinct key
+
+    {
+        auto txn = env.txn_rw();
+        env.dbi_Phrase__splitWords.del(txn, "quick", lmdb::to_sv<uint64_t>(5));
+        txn.commit();
+    }
+
+    {
+        verify(!env.verify_Phrase().ok());
+
+        auto txn = env.txn_rw();
+        env.rebuildIndex_Phrase__splitWords(txn);
+        txn.commit();
+
+        verify(env.verify_Phrase().ok());
+    }
+
+
+
+    // Unique-index filters: misses skip the DBI probe, results never change
+
+    {
+        auto before = env.filterStats_User__userName();
+
+        auto txn = env.txn_ro();
+
+        for (int i = 0; i < 1000; i++) {
+            verify(!env.lookup_User__userName(txn, std::string("missing") + std::to_string(i)));
+        }
+
+        verify(env.lookup_User__userName(txn, "john")->primaryKeyId == 1);
+
+        auto after = env.filterStats_User__userName();
+
+        verify(after.lookups - before.lookups == 1001);
+        verify(after.skipped - before.skipped > 950); // ~1% false positive rate
+        verify(after.skipped - before.skipped + after.falsePositives - before.falsePositives == 1000);
+    }
+
+    {
+        auto txn = env.txn_rw();
+
+        env.insert_User(txn, "filtered", "", 1);
+        verify(env.lookup_User__userName(txn, "filtered"));
+        verifyThrow(env.insert_User(txn, "filtered", "", 2), "unique constraint violated: User.userName");
+
+        auto view = env.lookup_User__userName(txn, "filtered");
+        env.update_User(txn, *view, { .userName = "filtered2" });
+        verify(env.lookup_User__userName(txn, "filtered2"));
+        verify(!env.lookup_User__userName(txn, "filtered")); // still in the filter, but the probe finds nothing
+
+        txn.abort();
+    }
+
+    {
+        auto txn = env.txn_rw();
+        for (int i = 0; i < 200; i++) env.insert_User(txn, std::string("stale") + std::to_string(i), "", 1);
+        txn.abort();
+    }
+
+    {
+        auto txn = env.txn_ro();
+        verify(!env.lookup_User__userName(txn, "filtered2")); // aborted inserts left bits set, lookups are still correct
+        verify(!env.lookup_User__userName(txn, "stale0"));
+    }
+
+    {
+        auto txn = env.txn_rw();
+        env.insert_Person(txn, "Fil", "Fil@Example.com", 30, "user");
+        verifyThrow(env.insert_Person(txn, "Fil", "FIL@example.com", 30, "user"), "unique constraint violated: Person.emailLC");
+        txn.abort();
+    }
+
+    // Rebuilding the filter from the index DBI clears stale bits
+
+    {
+        auto txn = env.txn_ro();
+        env.rebuildFilter_User__userName(txn);
+
+        auto before = env.filterStats_User__userName();
+        for (int i = 0; i < 200; i++) verify(!env.lookup_User__userName(txn, std::string("stale") + std::to_string(i)));
+        verify(env.filterStats_User__userName().skipped - before.skipped > 190);
+    }
+
+    // Filter is built from the index DBI on open, so keys written by an earlier process are found
+
+    {
+        verify(system("mkdir -p db/filter/") == 0);
+        verify(system("rm -f db/filter/data.mdb") == 0);
+
+        {
+            example::environment filterEnv;
+            filterEnv.open("db/filter/");
+
+            auto txn = filterEnv.txn_rw();
+            filterEnv.insert_User(txn, "persisted", "", 1);
+            txn.commit();
+        }
+
+        {
+            example::environment filterEnv;
+            filterEnv.open("db/filter/");
+
+            auto txn = filterEnv.txn_rw();
+            verify(filterEnv.lookup_User__userName(txn, "persisted"));
+            verifyThrow(filterEnv.insert_User(txn, "persisted", "", 2), "unique constraint violated: User.userName");
+        }
+
+        // And with filters disabled at open, lookups behave the same but every one probes the DBI
+
+        {
+            example::environment filterEnv;
+            filterEnv.open("db/filter/", { .uniqueFilters = false });
+
+            auto txn = filterEnv.txn_ro();
+            verify(filterEnv.lookup_User__userName(txn, "persisted"));
+            verify(!filterEnv.lookup_User__userName(txn, "absent"));
+            verify(filterEnv.filterStats_User__userName().skipped == 0);
+        }
+    }
+
+    // Filters only see this environment's own writes. Every txn compares LMDB's txn id with the last one this
+    // environment committed, and a commit from any other environment or process marks the filter stale so
+    // lookups and unique checks probe the DBI until the filter is rebuilt
+
+    {
+        verify(system("mkdir -p db/filter/") == 0);
+        verify(system("rm -f db/filter/data.mdb") == 0);
+
+        example::environment envA;
+        envA.open("db/filter/");
+
+        {
+            auto txn = envA.txn_rw();
+            envA.insert_User(txn, "fromA", "", 1);
+            txn.commit();
+        }
+
+        verify(!envA.filterStats_User__userName().stale);
+
+        // The second writer is another process: LMDB doesn't allow opening one env twice in a process. The
+        // child never touches envA, it opens its own env and reports back through its exit status
+
+        pid_t pid = fork();
+        verify(pid >= 0);
+
+        if (pid == 0) {
+            int status = 1;
+
+            try {
+                example::environment envB;
+                envB.open("db/filter/");
+
+                auto txn = envB.txn_rw();
+                if (envB.lookup_User__userName(txn, "fromA")) {
+                    envB.insert_User(txn, "fromB", "", 3);
+                    txn.commit();
+                    status = 0;
+                }
+            } catch (...) {}
+
+            _exit(status);
+        }
+
+        int status;
+        verify(waitpid(pid, &status, 0) == pid);
+        verify(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+
+        // envA's filter has never seen "fromB". Stale filters never skip, so the row is found and the
+        // duplicate is still caught
+
+        {
+            auto txn = envA.txn_rw();
+            verify(envA.filterStats_User__userName().stale);
+
+            auto before = envA.filterStats_User__userName();
+            verify(envA.lookup_User__userName(txn, "fromB"));
+            verify(!envA.lookup_User__userName(txn, "absent"));
+            verify(envA.filterStats_User__userName().skipped == before.skipped);
+
+            verifyThrow(envA.insert_User(txn, "fromB", "", 4), "unique constraint violated: User.userName");
+        }
+
+        // Rebuilding brings both keys into the filter and clears the flag
+
+        {
+            auto txn = envA.txn_rw();
+            envA.rebuildFilter_User__userName(txn);
+            verify(!envA.filterStats_User__userName().stale);
+
+            verifyThrow(envA.insert_User(txn, "fromB", "", 4), "unique constraint violated: User.userName");
+
+            auto before = envA.filterStats_User__userName();
+            for (int i = 0; i < 100; i++) verify(!envA.lookup_User__userName(txn, std::string("absent") + std::to_string(i)));
+            verify(envA.filterStats_User__userName().skipped - before.skipped > 90);
+        }
+    }
+
+
+
+    // Sharded environments
+
+    {
+        verify(system("rm -rf db/shards/ && mkdir -p db/shards/") == 0);
+
+        example::sharded_environment senv;
+        senv.open("db/shards/", 4); // db/shards/0 .. db/shards/3
+
+        verify(senv.numShards() == 4);
+
+        // Partition a batch by shard key and write all shards in parallel, one writer each
+
+        std::vector<std::vector<uint64_t>> byShard(4);
+        for (uint64_t i = 0; i < 1000; i++) byShard[senv.shardFor_User("s" + std::to_string(i))].push_back(i);
+
+        senv.writeShards([&](size_t shard, auto &shardEnv, auto &txn){
+            for (auto i : byShard[shard]) shardEnv.insert_User(txn, "s" + std::to_string(i), "", i % 100);
+        });
+
+        uint64_t total = 0;
+
+        for (size_t shard = 0; shard < 4; shard++) {
+            verify(byShard[shard].size() > 150); // hash-partitioned, roughly even
+
+            auto txn = senv.shard(shard).txn_ro();
+            uint64_t count = 0;
+            senv.shard(shard).foreach_User(txn, [&](auto &view){
+                verify(senv.shardFor_User(view.userName()) == shard);
+                count++;
+                return true;
+            });
+            verify(count == byShard[shard].size());
+            total += count;
+        }
+
+        verify(total == 1000);
+
+        // Point lookups are routed to a single shard
+
+        {
+            auto txns = senv.txn_ro();
+
+            auto view = senv.lookup_User__userName(txns, "s123");
+            verify(view);
+            verify(view->userName() == "s123");
+            verify(view->created() == 23);
+            verify(view.shard == senv.shardFor_User("s123"));
+
+            verify(!senv.lookup_User__userName(txns, "nobody"));
+        }
+
+        // Same key always lands on the same shard, so uniqueness is still enforced
+
+        verifyThrow(senv.writeShard(senv.shardFor_User("s5"), [&](auto &shardEnv, auto &txn){
+            shardEnv.insert_User(txn, "s5", "", 0);
+        }), "unique constraint violated: User.userName");
+
+        // Index scans are an ordered k-way merge over all shards
+
+        {
+            auto txns = senv.txn_ro();
+
+            std::vector<uint64_t> created;
+            uint64_t scanTotal;
+
+            senv.foreach_User__created(txns, [&](auto &view){
+                created.push_back(view->created());
+                return true;
+            }, false, std::nullopt, &scanTotal);
+
+            verify(created.size() == 990); // created == 0 isn't indexed
+            verify(scanTotal == 990);
+            verify(std::is_sorted(created.begin(), created.end()));
+
+            std::vector<std::string> names;
+
+            senv.foreach_User__userName(txns, [&](auto &view){
+                names.push_back(std::string(view->userName()));
+                return names.size() < 5;
+            }, false, "s99");
+
+            verify(names == std::vector<std::string>({"s99", "s990", "s991", "s992", "s993"}));
+
+            created.clear();
+
+            senv.foreach_User__created(txns, [&](auto &view){
+                created.push_back(view->created());
+                return true;
+            }, true, 50);
+
+            verify(created.size() == 500);
+            verify(created.front() == 50 && created.back() == 1);
+            verify(std::is_sorted(created.rbegin(), created.rend()));
+        }
+
+        // Primary keys are unique across shards: shard k allocates k+1, k+1+N, k+1+2N, ... so the ID alone
+        // routes to its shard
+
+        {
+            auto txns = senv.txn_ro();
+
+            std::set<uint64_t> ids;
+
+            for (size_t shard = 0; shard < 4; shard++) {
+                auto txn = senv.shard(shard).txn_ro();
+                senv.shard(shard).foreach_User(txn, [&](auto &view){
+                    verify(senv.shardForId_User(view.primaryKeyId) == shard);
+                    ids.insert(view.primaryKeyId);
+                    return true;
+                });
+            }
+
+            verify(ids.size() == 1000);
+
+            auto s123 = senv.lookup_User__userName(txns, "s123");
+            auto byId = senv.lookup_User(txns, s123->primaryKeyId);
+            verify(byId);
+            verify(byId->userName() == "s123");
+            verify(byId.shard == s123.shard);
+
+            // foreach_ over the table itself merges by primary key
+
+            std::vector<uint64_t> merged;
+
+            senv.foreach_User(txns, [&](auto &view){
+                merged.push_back(view->primaryKeyId);
+                return true;
+            });
+
+            verify(merged == std::vector<uint64_t>(ids.begin(), ids.end()));
+        }
+
+        // Aggregates are kept per shard and summed when read through the sharded environment
+
+        {
+            auto txns = senv.txn_ro();
+
+            uint64_t perShard = 0;
+
+            for (size_t shard = 0; shard < 4; shard++) {
+                auto txn = senv.shard(shard).txn_ro();
+                auto agg = senv.shard(shard).aggregate_User__usersByDay(txn, 0);
+                verify(agg && agg->count == byShard[shard].size());
+                perShard += agg->count;
+            }
+
+            verify(perShard == 1000);
+            verify(senv.aggregate_User__usersByDay(txns, 0)->count == 1000);
+        }
+
+        // Rows that ref a sharded table live on the referenced row's shard, so ref checks, restrict and
+        // cascade never cross shards. A null ref goes to shard 0
+
+        {
+            uint64_t userId, otherShard;
+
+            {
+                auto txns = senv.txn_ro();
+                auto user = senv.lookup_User__userName(txns, "s7");
+                userId = user->primaryKeyId;
+                otherShard = (user.shard + 1) % 4;
+            }
+
+            verify(senv.shardFor_Session(userId) == senv.shardForId_User(userId));
+            verify(senv.shardFor_Account(userId) == senv.shardForId_User(userId));
+            verify(senv.shardFor_Account(0) == 0);
+
+            senv.writeShard(senv.shardFor_Session(userId), [&](auto &shardEnv, auto &txn){
+                shardEnv.insert_Session(txn, userId, "tok");
+            });
+
+            verifyThrow(senv.writeShard(otherShard, [&](auto &shardEnv, auto &txn){
+                shardEnv.insert_Session(txn, userId, "tok");
+            }), "referenced row not found");
+
+            senv.writeShard(senv.shardForId_User(userId), [&](auto &shardEnv, auto &txn){
+                shardEnv.delete_User(txn, userId);
+            });
+
+            auto txn = senv.shard(senv.shardForId_User(userId)).txn_ro();
+            uint64_t sessions = 0;
+            senv.shard(senv.shardForId_User(userId)).foreach_Session(txn, [&](auto &){ sessions++; return true; });
+            verify(sessions == 0); // cascaded on the same shard
+        }
+    }
+
+    // Reopening with a different shard count would misroute keys, so it's refused
+
+    {
+        example::sharded_environment senv;
+        verifyThrow(senv.open("db/shards/", 8), "shard count mismatch");
+    }
+
+
+
+    // Materialized aggregates, maintained by insert/update/delete since the start of this test
+
+    auto roleGroups = [&](auto &txn){
+        std::vector<std::string> out;
+
+        env.aggregate_Person__countByRole(txn, [&](auto key, auto &agg){
+            out.push_back(std::string(key) + ":" + std::to_string(agg.count) + ":" + std::to_string(agg.sum_age));
+            return true;
+        });
+
+        return out;
+    };
+
+    {
+        auto txn = env.txn_ro();
+
+        verify(roleGroups(txn) == std::vector<std::string>({"admin:1:40", "user:3:55"}));
+
+        auto user = env.aggregate_Person__countByRole(txn, "user");
+        verify(user);
+        verify(user->count == 3);
+        verify(user->sum_age == 55);
+        verify(!env.aggregate_Person__countByRole(txn, "ghostrole"));
+
+        auto day0 = env.aggregate_User__usersByDay(txn, 0);
+        verify(day0 && day0->count == 5);
+    }
+
+    {
+        auto txn = env.txn_rw();
+
+        env.insert_Person(txn, "Agg", "agg@example.com", 10, "auditor"); // new group
+
+        auto view = env.lookup_Person(txn, 3); // alice: user -> admin
+        env.update_Person(txn, *view, { .role = "admin" });
+
+        view = env.lookup_Person(txn, 2); // john: age 30 -> 31, same group
+        env.update_Person(txn, *view, { .age = 31 });
+
+        verify(roleGroups(txn) == std::vector<std::string>({"admin:2:45", "auditor:1:10", "user:2:51"}));
+
+        env.insert_User(txn, "day2", "", 2 * 86400 + 5);
+        env.insert_User(txn, "day2b", "", 2 * 86400 + 500);
+
+        std::vector<uint64_t> days;
+
+        env.aggregate_User__usersByDay(txn, [&](auto day, auto &agg){
+            days.push_back(day);
+            days.push_back(agg.count);
+            return true;
+        });
+
+        verify(days == std::vector<uint64_t>({0, 5, 2, 2}));
+
+        txn.abort();
+    }
+
+    // Aborted txn left the aggregates untouched
+
+    {
+        auto txn = env.txn_ro();
+        verify(roleGroups(txn) == std::vector<std::string>({"admin:1:40", "user:3:55"}));
+        verify(!env.aggregate_User__usersByDay(txn, 2));
+    }
+
+    // Deleting the last row of a group removes the group
+
+    {
+        auto txn = env.txn_rw();
+
+        env.delete_Person(txn, 4);
+        verify(roleGroups(txn) == std::vector<std::string>({"user:3:55"}));
+
+        // Rebuilding from rows gives the same result as incremental maintenance
+
+        env.rebuildAggregate_Person__countByRole(txn);
+        verify(roleGroups(txn) == std::vector<std::string>({"user:3:55"}));
+
+        txn.abort();
+    }
+
+
+
+    // Page-cache warmup
+
+    {
+        auto all = env.warmup();
+        verify(all.leafPages > 0);
+        verify(all.branchPages + all.leafPages + all.overflowPages == all.pagesTouched);
+
+        auto some = env.warmup({ "User", "Person__fullNameLC" }, { .threads = 4 });
+        verify(some.leafPages > 0);
+        verify(some.pagesTouched < all.pagesTouched);
+
+        verifyThrow(env.warmup({ "NoSuchTable" }), "unknown table or index: NoSuchTable");
+    }
+
+    // Readahead and access-pattern advice are open options and scan advice is opt-in; they change performance
+    // only, never results
+
+    {
+        verify(system("mkdir -p db/hints/") == 0);
+        verify(system("rm -f db/hints/data.mdb") == 0);
+
+        {
+            example::environment hintsEnv;
+            hintsEnv.open("db/hints/");
+
+            // Every 100th user gets a passwordHash larger than a page, so User has overflow pages
+
+            auto txn = hintsEnv.txn_rw();
+            for (uint64_t i = 0; i < 1000; i++) hintsEnv.insert_User(txn, "h" + std::to_string(i), i % 100 == 0 ? std::string(10000, 'p') : "", i + 1);
+            txn.commit();
+        }
+
+        for (auto pattern : { example::AccessPattern::Random, example::AccessPattern::Sequential }) {
+            example::environment hintsEnv;
+            hintsEnv.open("db/hints/", { .readahead = pattern == example::AccessPattern::Sequential, .accessPattern = pattern });
+
+            unsigned int flags;
+            mdb_env_get_flags(hintsEnv.lmdb_env.handle(), &flags);
+            verify((flags & MDB_NORDAHEAD) == (pattern == example::AccessPattern::Random ? MDB_NORDAHEAD : 0));
+
+            auto txn = hintsEnv.txn_ro();
+
+            uint64_t count = 0;
+
+            hintsEnv.foreach_User__created(txn, [&](auto &view){
+                count++;
+                return true;
+            });
+
+            verify(count == 1000);
+            verify(hintsEnv.lookup_User__userName(txn, "h500")->created() == 501);
+
+            // The access pattern is applied to the map once, at open. madvise on the whole map is process-global
+            // and takes mmap_lock for write, so scans never change it. Per-scan advice is opt-in and range-limited:
+            // while a scanAdvice guard is alive, foreach_ over that DBI advises MADV_WILLNEED on the next few leaf
+            // pages as the cursor reaches them. Overlapping scans each keep their own guard
+
+            {
+                auto outerAdvice = hintsEnv.scanAdvice(txn, "User__created", { .prefetchPages = 8 });
+
+                uint64_t outer = 0, inner = 0;
+
+                hintsEnv.foreach_User__created(txn, [&](auto &view){
+                    if (outer++ == 500) {
+                        auto innerAdvice = hintsEnv.scanAdvice(txn, "User__userName", { .prefetchPages = 8 });
+
+                        hintsEnv.foreach_User__userName(txn, [&](auto &view){
+                            inner++;
+                            return true;
+                        });
+
+                        verify(innerAdvice.pagesAdvised() > 0);
+                    }
+
+                    return true;
+                });
+
+                verify(outer == 1000);
+                verify(inner == 1000);
+                verify(outerAdvice.pagesAdvised() > 0);
+            }
+
+            verifyThrow(hintsEnv.scanAdvice(txn, "NoSuchIndex"), "unknown table or index: NoSuchIndex");
+
+            // Overflow pages are touched by default and can be left cold
+
+            auto withOverflow = hintsEnv.warmup({ "User" });
+            verify(withOverflow.overflowPages > 0);
+
+            auto withoutOverflow = hintsEnv.warmup({ "User" }, { .overflowPages = false });
+            verify(withoutOverflow.overflowPages == 0);
+            verify(withoutOverflow.leafPages == withOverflow.leafPages);
+            verify(withoutOverflow.pagesTouched == withOverflow.pagesTouched - withOverflow.overflowPages);
+        }
+    }
+
+
+
+    // Foreign keys and joins
+
+    {
+        auto txn = env.txn_rw();
+
+        env.insert_Account(txn, 5, "bob-main"); // 1
+        env.insert_Account(txn, 1, "john-main"); // 2
+        env.insert_Account(txn, 5, "bob-alt"); // 3
+        env.insert_Account(txn, 0, "unowned"); // 4, 0 is a null ref
+        env.insert_Account(txn, 4, "zoya-main"); // 5
+
+        verifyThrow(env.insert_Account(txn, 3, "dangling"), "referenced row not found: Account.owner -> User");
+
+        env.insert_Session(txn, 5, "\x01"); // 1
+        env.insert_Session(txn, 6, "\x02"); // 2
+        env.insert_Session(txn, 5, "\x03"); // 3
+
+        txn.commit();
+    }
+
+    // Join resolves refs in sorted batches but calls back in Account order
+
+    {
+        auto txn = env.txn_ro();
+
+        std::vector<std::string> rows;
+
+        env.join_Account__owner(txn, [&](auto &account, auto &owner){
+            rows.push_back(std::string(account.label()) + "=" + (owner ? std::string(owner->userName()) : "null"));
+            return true;
+        }, { .batchSize = 2 });
+
+        verify(rows == std::vector<std::string>({ "bob-main=bob", "john-main=john", "bob-alt=bob", "unowned=null", "zoya-main=zoya" }));
+
+        // Reverse direction uses the automatic ref index
+
+        std::vector<uint64_t> ids;
+
+        env.foreachDup_Account__owner(txn, 5, [&](auto &view){
+            ids.push_back(view.primaryKeyId);
+            return true;
+        });
+
+        verify(ids == std::vector<uint64_t>({1, 3}));
+    }
+
+    // Join over a subset of rows, eg from an index scan
+
+    {
+        auto txn = env.txn_ro();
+
+        std::vector<std::string> names;
+
+        env.join_Session__user(txn, std::vector<uint64_t>({ 3, 2, 1 }), [&](auto &session, auto &user){
+            names.push_back(std::to_string(session.primaryKeyId) + ":" + std::string(user->userName()));
+            return true;
+        });
+
+        verify(names == std::vector<std::string>({ "3:bob", "2:bob2", "1:bob" }));
+    }
+
+    // onDelete: restrict blocks deleting a referenced User, cascade removes dependants
+
+    {
+        auto txn = env.txn_rw();
+
+        verifyThrow(env.delete_User(txn, 5), "delete restricted: User 5 is referenced by Account.owner");
+
+        env.delete_User(txn, 6); // only referenced by a Session, which cascades
+
+        verify(!env.lookup_User(txn, 6));
+        verify(!env.lookup_Session(txn, 2));
+        verify(env.lookup_Session(txn, 1));
+
+        // Updating a ref is checked the same way as inserting one
+
+        auto view = env.lookup_Account(txn, 4);
+        verifyThrow(env.update_Account(txn, *view, { .owner = 6 }), "referenced row not found: Account.owner -> User");
+        env.update_Account(txn, *view, { .owner = 2 });
+
+        std::vector<uint64_t> ids;
+
+        env.foreachDup_Account__owner(txn, 2, [&](auto &view){
+            ids.push_back(view.primaryKeyId);
+            return true;
+        });
+
+        verify(ids == std::vector<uint64_t>({4}));
+
+        txn.abort();
+    }
+
+    {
+        auto txn = env.txn_rw();
+        env.truncate_Account(txn);
+        env.truncate_Session(txn);
+        txn.commit();
+    }
+
+
+
+    // Lazy DBI opening. Only one txn at a time may call mdb_dbi_open, and a handle opened in a txn is invisible
+    // to other txns until that txn ends (and lost if it's a read txn that doesn't commit). So lazy handles are
+    // opened under one env-wide mutex, each in its own short read txn that is committed before the handle is
+    // published. LMDB copies the handle table when a txn begins, so a txn that began before a handle was
+    // published can't use it: that first use throws a retryable error, and writeTxn() and withReadTxn() retry
+    // their callback on a fresh txn
+
+    {
+        verify(env.openedDbis() == example::environment::numDbis()); // default is to open everything up front
+
+        verify(system("mkdir -p db/lazy/") == 0);
+        verify(system("rm -f db/lazy/data.mdb") == 0);
+
+        {
+            example::environment lazyEnv;
+            lazyEnv.open("db/lazy/");
+
+            auto txn = lazyEnv.txn_rw();
+            lazyEnv.insert_SimpleDups(txn, "AAAA");
+            lazyEnv.insert_User(txn, "lazy", "", 1);
+            lazyEnv.insert_Person(txn, "Lazy", "lazy@example.com", 30, "user");
+            txn.commit();
+        }
+
+        example::environment lazyEnv;
+        lazyEnv.open("db/lazy/", { .lazyDbis = true });
+
+        verify(lazyEnv.openedDbis() == 0);
+
+        // Unique-index filters are built from their DBI when it is first opened, not at open()
+
+        verify(!lazyEnv.filterStats_User__userName().built);
+        verify(!lazyEnv.filterStats_Person__emailLC().built);
+
+        // The txn that triggers the open began before the handle existed. The handle is still published, so
+        // the next txn can use it
+
+        {
+            auto txn = lazyEnv.txn_ro();
+            verifyThrow(lazyEnv.lookup_SimpleDups(txn, 1), "DBI opened after txn began");
+        }
+
+        verify(lazyEnv.openedDbis() == 1);
+
+        {
+            auto txn = lazyEnv.txn_ro();
+            verify(lazyEnv.lookup_SimpleDups(txn, 1));
+        }
+
+        // withReadTxn retries transparently
+
+        {
+            auto id = lazyEnv.withReadTxn([&](auto &txn){
+                return lazyEnv.lookup_User__userName(txn, "lazy")->primaryKeyId;
+            });
+
+            verify(id == 1);
+            verify(lazyEnv.openedDbis() == 3); // SimpleDups, User, User__userName
+            verify(lazyEnv.filterStats_User__userName().builds == 1);
+            verify(!lazyEnv.filterStats_Person__emailLC().built);
+        }
+
+        // A unique check can be the first use too. insert_ opens all of the table's DBIs together, and the
+        // filter is built before it is consulted, so rows written before open() are still caught
+
+        verifyThrow(lazyEnv.writeTxn([&](auto &txn){
+            lazyEnv.insert_Person(txn, "Lazy2", "LAZY@example.com", 31, "user");
+        }), "unique constraint violated: Person.emailLC");
+
+        verify(lazyEnv.filterStats_Person__emailLC().builds == 1);
+
+        // Aborting the write txn that triggered an open doesn't lose the handles, they were committed in
+        // their own txn
+
+        {
+            auto txn = lazyEnv.txn_rw();
+            verifyThrow(lazyEnv.insert_Phrase(txn, "lazy words"), "DBI opened after txn began");
+            txn.abort();
+        }
+
+        {
+            auto opened = lazyEnv.openedDbis();
+
+            auto txn = lazyEnv.txn_rw();
+            lazyEnv.insert_Phrase(txn, "lazy words");
+            txn.commit();
+
+            verify(lazyEnv.openedDbis() == opened);
+        }
+
+        // Threads racing on first use of different DBIs: the env-wide mutex serialises their mdb_dbi_open
+        // calls, two threads per table race on the same one, and each is opened once. Threads only count
+        // failures, since a verify throwing inside a thread would call std::terminate
+
+        {
+            std::vector<std::function<void(lmdb::txn &)>> firstUses = {
+                [&](auto &txn){ lazyEnv.lookup_SomeRecord(txn, 1); },
+                [&](auto &txn){ lazyEnv.lookup_MultiRecs(txn, 1); },
+                [&](auto &txn){ lazyEnv.lookup_MyOpaqueTable(txn, 1); },
+                [&](auto &txn){ lazyEnv.lookup_MyOpaqueTableAutoPrimary(txn, 1); },
+                [&](auto &txn){ lazyEnv.lookup_Embedding(txn, 1); },
+                [&](auto &txn){ lazyEnv.lookup_Tagged(txn, 1); },
+                [&](auto &txn){ lazyEnv.lookup_CompressedDoc(txn, 1); },
+                [&](auto &txn){ lazyEnv.lookup_Account(txn, 1); },
+            };
+
+            auto before = lazyEnv.openedDbis();
+
+            std::vector<std::thread> threads;
+            std::atomic<uint64_t> failures = 0;
+
+            for (int i = 0; i < 16; i++) {
+                threads.emplace_back([&, i]{
+                    try {
+                        lazyEnv.withReadTxn([&](auto &txn){
+                            firstUses[i % firstUses.size()](txn);
+                        });
+                    } catch (const std::exception &) {
+                        failures++;
+                    }
+                });
+            }
+
+            for (auto &t : threads) t.join();
+
+            verify(failures == 0);
+            verify(lazyEnv.openedDbis() == before + firstUses.size());
+        }
+
+        // A txn that another thread began before the handle was published can't use it, even after it's
+        // published. That thread's next txn can
+
+        {
+            std::promise<void> txnStarted, published;
+            std::string threadError;
+
+            auto scanCreated = [&](auto &txn){
+                uint64_t n = 0;
+                lazyEnv.foreach_User__created(txn, [&](auto &){ n++; return true; });
+                return n;
+            };
+
+            std::thread t([&]{
+                try {
+                    {
+                        auto txn = lazyEnv.txn_ro();
+                        txnStarted.set_value();
+                        published.get_future().wait();
+
+                        try {
+                            scanCreated(txn);
+                            threadError = "old txn used a handle published after it began";
+                        } catch (const std::runtime_error &e) {
+                            if (std::string(e.what()).find("DBI opened after txn began") == std::string::npos) threadError = e.what();
+                        }
+                    }
+
+                    auto txn = lazyEnv.txn_ro();
+                    if (scanCreated(txn) != 1) threadError = "new txn didn't see the row";
+                } catch (const std::exception &e) {
+                    threadError = e.what();
+                }
+            });
+
+            txnStarted.get_future().wait();
+            verify(lazyEnv.withReadTxn(scanCreated) == 1);
+            published.set_value();
+
+            t.join();
+
+            verify(threadError == "");
+        }
+    }
+
+
+
+    // Random sampling
+
+    {
+        auto txn = env.txn_rw();
+
+        std::vector<uint64_t> ids;
+
+        for (uint64_t i = 0; i < 10000; i++) {
+            ids.push_back(env.insert_User(txn, "sample" + std::to_string(i), "", 10000 + i));
+        }
+
+        // Leave holes so probes into deleted IDs have to be rejected
+
+        for (uint64_t i = 0; i < ids.size(); i += 3) env.delete_User(txn, ids[i]);
+
+        auto sample = [&](uint64_t n, uint64_t seed){
+            std::vector<uint64_t> out;
+
+            env.sample_User(txn, n, seed, [&](auto &view){
+                out.push_back(view.primaryKeyId);
+                return true;
+            });
+
+            return out;
+        };
+
+        auto s1 = sample(2000, 42);
+
+        verify(s1.size() == 2000);
+        verify(sample(2000, 42) == s1); // deterministic per seed
+        verify(sample(2000, 43) != s1);
+
+        std::set<uint64_t> distinct(s1.begin(), s1.end());
+        verify(distinct.size() == s1.size()); // without replacement
+
+        for (auto id : s1) verify(env.lookup_User(txn, id));
+
+        // Roughly uniform over the surviving bulk-inserted rows: every tenth of the ID range gets its share
+
+        std::vector<uint64_t> buckets(10);
+        for (auto id : s1) {
+            if (id < ids.front()) continue; // one of the handful of rows from earlier tests
+            buckets[std::min<uint64_t>(9, (id - ids.front()) * 10 / ids.size())]++;
+        }
+        for (auto b : buckets) verify(b > 100 && b < 300);
+
+        // Asking for more rows than exist returns each row once
+
+        uint64_t numRows = 0;
+        env.foreach_User(txn, [&](auto &view){
+            numRows++;
+            return true;
+        });
+        verify(sample(1'000'000, 1).size() == numRows);
+
+        // Sampling within an index range
+
+        std::vector<uint64_t> created;
+
+        env.sample_User__created(txn, { 12000, 13000 }, 50, 7, [&](auto &view){
+            created.push_back(view.created());
+            return true;
+        });
+
+        verify(created.size() == 50);
+        for (auto c : created) verify(c >= 12000 && c < 13000);
+
+        txn.abort();
+    }
+
+    // Approximate top-K by frequency over a dup index
+
+    {
+        auto txn = env.txn_rw();
+
+        for (uint64_t i = 0; i < 20000; i++) {
+            if (i % 2 == 0) env.insert_SimpleDups(txn, "HOT");
+            else if (i % 4 == 1) env.insert_SimpleDups(txn, "WARM");
+            else env.insert_SimpleDups(txn, "cold" + std::to_string(i));
+        }
+
+        auto top = env.topK_SimpleDups__stuff(txn, 2, { .sampleSize = 2000, .seed = 1 });
+
+        verify(top.size() == 2);
+        verify(top[0].key == "HOT");
+        verify(top[1].key == "WARM");
+        verify(top[0].estimatedCount > 8000 && top[0].estimatedCount < 12000);
+        verify(top[1].estimatedCount > 4000 && top[1].estimatedCount < 6000);
+
+        txn.abort();
+    }
+
+
+
+    // Durability modes and the durable-commit watermark
+
+    {
+        verify(system("mkdir -p db/durable/") == 0);
+        verify(system("rm -f db/durable/data.mdb") == 0);
+
+        {
+            example::environment durEnv;
+            durEnv.open("db/durable/", { .durability = example::Durability::NoSync, .syncInterval = std::chrono::milliseconds(50) });
+
+            verify(durEnv.durableSeq() == durEnv.commitSeq());
+
+            uint64_t prev = 0;
+
+            for (uint64_t i = 0; i < 20; i++) {
+                auto txn = durEnv.txn_rw();
+                durEnv.insert_User(txn, "dur" + std::to_string(i), "", i);
+                auto seq = durEnv.commit(txn, example::CommitMode::Async);
+
+                verify(seq > prev);
+                verify(durEnv.durableSeq() <= seq);
+                prev = seq;
+            }
+
+            // The background thread catches up within the sync interval, batching many commits per sync
+
+            durEnv.waitDurable(prev);
+            verify(durEnv.durableSeq() >= prev);
+            verify(durEnv.syncCount() >= 1);
+            verify(durEnv.syncCount() <= 20);
+
+            // Per-call choice: this commit doesn't return until it is synced
+
+            {
+                auto txn = durEnv.txn_rw();
+                durEnv.insert_User(txn, "durWait", "", 1);
+                auto seq = durEnv.commit(txn, example::CommitMode::WaitDurable);
+                verify(durEnv.durableSeq() >= seq);
+            }
+
+            // Concurrent waiters on the same watermark are all released by one sync
+
+            uint64_t seq;
+
+            {
+                auto txn = durEnv.txn_rw();
+                durEnv.insert_User(txn, "durShared", "", 1);
+                seq = durEnv.commit(txn, example::CommitMode::Async);
+            }
+
+            std::vector<std::thread> waiters;
+            for (int i = 0; i < 8; i++) waiters.emplace_back([&]{ durEnv.waitDurable(seq); });
+            for (auto &t : waiters) t.join();
+
+            verify(durEnv.durableSeq() >= seq);
+
+            // Plain txn.commit() still works and counts as an async commit
+
+            {
+                auto txn = durEnv.txn_rw();
+                durEnv.insert_User(txn, "durPlain", "", 1);
+                txn.commit();
+                verify(durEnv.commitSeq() == seq + 1);
+            }
+        } // closing the environment syncs everything outstanding
+
+        {
+            example::environment durEnv;
+            durEnv.open("db/durable/");
+
+            auto txn = durEnv.txn_ro();
+            verify(durEnv.lookup_User__userName(txn, "dur19"));
+            verify(durEnv.lookup_User__userName(txn, "durPlain"));
+        }
+
+        // Without a sync interval firing, only the byte budget, a waiter or closing the environment syncs
+
+        {
+            example::environment durEnv;
+            durEnv.open("db/durable/", {
+                .durability = example::Durability::NoSync,
+                .syncInterval = std::chrono::hours(1),
+                .syncBytes = 64 * 1024,
+            });
+
+            uint64_t startSeq = durEnv.durableSeq();
+
+            uint64_t seq = 0;
+
+            for (uint64_t i = 0; i < 10; i++) {
+                auto txn = durEnv.txn_rw();
+                durEnv.insert_User(txn, "budget" + std::to_string(i), "", i);
+                seq = durEnv.commit(txn, example::CommitMode::Async);
+            }
+
+            // 10 small records are far below the budget, so nothing was synced. Checked without waitDurable(),
+            // which would wake the syncer
+
+            std::this_thread::sleep_for(std::chrono::milliseconds(200));
+            verify(durEnv.durableSeq() == startSeq);
+            verify(durEnv.syncCount() == 0);
+
+            // A commit that pushes the outstanding bytes past syncBytes triggers one sync, covering everything before it
+
+            {
+                auto txn = durEnv.txn_rw();
+                durEnv.insert_User(txn, "budgetBig", std::string(100 * 1024, 'b'), 1);
+                seq = durEnv.commit(txn, example::CommitMode::Async);
+            }
+
+            auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+            while (durEnv.durableSeq() < seq && std::chrono::steady_clock::now() < deadline) std::this_thread::sleep_for(std::chrono::milliseconds(10));
+
+            verify(durEnv.durableSeq() >= seq);
+            verify(durEnv.syncCount() == 1);
+
+            // Outstanding commits below the budget are synced by close()
+
+            {
+                auto txn = durEnv.txn_rw();
+                durEnv.insert_User(txn, "budgetClose", "", 1);
+                seq = durEnv.commit(txn, example::CommitMode::Async);
+            }
+
+            verify(durEnv.durableSeq() < seq);
+
+            durEnv.close();
+
+            verify(durEnv.syncCount() == 2);
+            verify(durEnv.durableSeq() == seq);
+            verify(durEnv.commitSeq() == seq);
+        }
+
+        // Waiting wakes the syncer instead of waiting out syncInterval: with a one-hour interval, a WaitDurable
+        // commit and a waitDurable() call each return as soon as one sync covers them
+
+        {
+            example::environment durEnv;
+            durEnv.open("db/durable/", { .durability = example::Durability::NoSync, .syncInterval = std::chrono::hours(1) });
+
+            auto start = std::chrono::steady_clock::now();
+
+            {
+                auto txn = durEnv.txn_rw();
+                durEnv.insert_User(txn, "durWake", "", 1);
+                auto seq = durEnv.commit(txn, example::CommitMode::WaitDurable);
+                verify(durEnv.durableSeq() >= seq);
+                verify(durEnv.syncCount() == 1);
+            }
+
+            {
+                auto txn = durEnv.txn_rw();
+                durEnv.insert_User(txn, "durWake2", "", 1);
+                auto seq = durEnv.commit(txn, example::CommitMode::Async);
+                verify(durEnv.durableSeq() < seq);
+
+                verify(durEnv.waitDurable(seq, std::chrono::seconds(10)));
+                verify(durEnv.syncCount() == 2);
+            }
+
+            verify(std::chrono::steady_clock::now() - start < std::chrono::seconds(10));
+        }
+
+        // Full durability: every commit is synced before it returns
+
+        {
+            example::environment durEnv;
+            durEnv.open("db/durable/", { .durability = example::Durability::Full });
+
+            auto txn = durEnv.txn_rw();
+            durEnv.insert_User(txn, "durFull", "", 1);
+            auto seq = durEnv.commit(txn, example::CommitMode::Async);
+            verify(durEnv.durableSeq() == seq);
+        }
+    }
+
+
+
+    std::cout << "All tests OK." << std::endl;
+
+    return 0;
+}
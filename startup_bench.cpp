@@ -0,0 +1,56 @@
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+
+#include "startup.h" // generated from startup_schema.pl, see Makefile
+
+
+#define verify(condition) do { if (!(condition)) throw hoytech::error(#condition, "  |  ", __FILE__, ":", __LINE__); } while(0)
+
+
+// Time from constructing an environment to finishing a first point lookup, the cost a
+// short-lived CLI tool or freshly forked worker pays. Only T0 is touched, so with lazy
+// DBI opening the other tables' handles are never opened.
+
+int main(int argc, char **argv) {
+    if (argc < 2) throw hoytech::error("usage: startup_bench <dir>");
+
+    std::string dir = argv[1];
+    const uint64_t iters = 200;
+
+    verify(system(("mkdir -p " + dir + " && rm -f " + dir + "/data.mdb").c_str()) == 0);
+
+    {
+        startup::environment env;
+        env.open(dir);
+
+        auto txn = env.txn_rw();
+        env.insert_T0(txn, "a", "b", "c", "d", "e", "f", "g", "h", "i", "j");
+        txn.commit();
+    }
+
+    for (bool lazy : { false, true }) {
+        auto start = std::chrono::steady_clock::now();
+        uint64_t openedDbis = 0;
+
+        for (uint64_t i = 0; i < iters; i++) {
+            startup::environment env;
+            env.open(dir, { .lazyDbis = lazy });
+
+            // Under lazyDbis the first lookup runs in a txn that predates the handle, withReadTxn retries it
+
+            verify(env.withReadTxn([&](auto &txn){ return !!env.lookup_T0__f0(txn, "a"); }));
+
+            openedDbis = env.openedDbis();
+        }
+
+        auto us = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count() / iters;
+
+        std::cout << std::setw(8) << startup::environment::numDbis()
+                  << std::setw(8) << (lazy ? "lazy" : "eager")
+                  << std::setw(12) << us << " us"
+                  << std::setw(8) << openedDbis << " dbis opened" << std::endl;
+    }
+
+    return 0;
+}
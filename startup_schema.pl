@@ -0,0 +1,20 @@
+#!/usr/bin/env perl
+
+## Emits a schema with the requested number of indices, for startup_bench.cpp
+##   perl startup_schema.pl 1000 > startup_1000.yaml
+
+use strict;
+
+my $numIndices = shift // die "usage: $0 <numIndices>";
+my $perTable = 10;
+
+print "db: startup\n\ntables:\n";
+
+for my $t (0 .. int(($numIndices - 1) / $perTable)) {
+    print "  T$t:\n    fields:\n";
+
+    for my $f (0 .. $perTable - 1) {
+        last if $t * $perTable + $f >= $numIndices;
+        print "      - name: f$f\n        type: string\n        index: true\n";
+    }
+}